@@ -0,0 +1,109 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Benchmark for EmbedLog. It prints the size of a logger, the cost of making
+ * one with and without a shared config, and the cost of logging directly and
+ * through the deferred ring.
+ *
+ */
+
+#include "EmbedLog/EmbedLog.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    constexpr int LOGGERS = 10000;
+    constexpr int MESSAGES = 100000;
+
+    uint64_t microseconds()
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // Runs a function and returns the nanoseconds it took per iteration
+    template <typename Function>
+    double time_per(int iterations, Function&& function)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        auto end = std::chrono::steady_clock::now();
+        return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+    }
+
+    std::unique_ptr<EmbedLog::EmbedLog> make_log()
+    {
+        return std::make_unique<EmbedLog::EmbedLog>(
+            []() { return true; },
+            []() { return true; },
+            [](const std::string&) {},
+            microseconds,
+            "Benchmark");
+    }
+}
+
+int main()
+{
+    std::printf("sizeof(EmbedLog): %zu bytes\n", sizeof(EmbedLog::EmbedLog));
+
+    std::vector<std::unique_ptr<EmbedLog::EmbedLog>> logs;
+    logs.reserve(2 * LOGGERS);
+
+    double full = time_per(LOGGERS, [&]() {
+        for (int i = 0; i < LOGGERS; i++)
+            logs.push_back(make_log());
+    });
+
+    EmbedLog::ConfigPointer config = logs.front()->getConfig();
+    double shared = time_per(LOGGERS, [&]() {
+        for (int i = 0; i < LOGGERS; i++)
+            logs.push_back(std::make_unique<EmbedLog::EmbedLog>(config));
+    });
+
+    std::printf("Construct with functions: %.1f ns\n", full);
+    std::printf("Construct from shared config: %.1f ns\n", shared);
+    logs.clear();
+
+    std::unique_ptr<EmbedLog::EmbedLog> log = make_log();
+    log->open();
+
+    double direct = time_per(MESSAGES, [&]() {
+        for (int i = 0; i < MESSAGES; i++)
+            log->log(EmbedLog::INFO, "Value %d of %s", i, "benchmark");
+    });
+    std::printf("log: %.1f ns\n", direct);
+
+    log->setDeferredCapacity(1 << 22);
+    double deferred = time_per(MESSAGES, [&]() {
+        for (int i = 0; i < MESSAGES; i++)
+            log->log_deferred(EmbedLog::INFO, "Value %d of %s", i, "benchmark");
+    });
+    double flushed = time_per(MESSAGES, [&]() { log->flush(); });
+    std::printf("log_deferred: %.1f ns, flush: %.1f ns per message\n", deferred, flushed);
+
+    log->close();
+    return 0;
+}
@@ -0,0 +1,83 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * BlockDevice describes raw flash that is erased in blocks and programmed in
+ * pages, for FlashStore to write lines to without a filesystem.
+ *
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace EmbedLog
+{
+    /**
+     * @class BlockDevice
+     * @brief Raw flash, such as NOR or NAND, without a filesystem.
+     *
+     * Erasing a block sets every byte to 0xFF. Programming may only be done in whole,
+     * aligned program units, and each unit is programmed at most once between erases.
+     */
+    class BlockDevice
+    {
+    public:
+        virtual ~BlockDevice() = default;
+
+        /**
+         * @brief Gets the size of an erase block in bytes.
+         */
+        virtual size_t getBlockSize() const = 0;
+
+        /**
+         * @brief Gets the number of erase blocks.
+         */
+        virtual size_t getBlockCount() const = 0;
+
+        /**
+         * @brief Gets the size of a program unit, such as a page, in bytes.
+         */
+        virtual size_t getProgramSize() const = 0;
+
+        /**
+         * @brief Reads bytes from a block.
+         *
+         * @return True if the read succeeded.
+         */
+        virtual bool read(size_t block, size_t offset, void* data, size_t size) = 0;
+
+        /**
+         * @brief Programs whole program units of a block.
+         *
+         * @return True if the program succeeded.
+         */
+        virtual bool program(size_t block, size_t offset, const void* data, size_t size) = 0;
+
+        /**
+         * @brief Erases a block to 0xFF.
+         *
+         * @return True if the erase succeeded.
+         */
+        virtual bool erase(size_t block) = 0;
+    };
+}
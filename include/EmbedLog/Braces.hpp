@@ -0,0 +1,251 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Braces adds {} placeholder format strings. The format is parsed by the
+ * compiler into a list of text and argument segments, so rendering does no
+ * parsing at run-time and a format that does not match its arguments fails
+ * to compile.
+ *
+ */
+
+
+#pragma once
+
+#include "EmbedLog/Capture.hpp"
+#include "EmbedLog/Formatter.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Brace Format Strings
+// EMBDL_FMT("x = {}, y = {:x}") makes a format parsed at compile time. Placeholders are
+// {} for any argument, {:x} or {:X} for hex integers and {:.N} for N decimal places.
+// Use {{ and }} for literal braces.
+#define EMBDL_FMT(text)                                                                \
+    ([]() {                                                                            \
+        struct EmbdlFormatSource                                                       \
+        {                                                                              \
+            static constexpr const char* value() { return text; }                      \
+        };                                                                             \
+        return ::EmbedLog::BraceFormat<EmbdlFormatSource>{};                           \
+    }())
+
+// Splits a macro argument list into the first argument and ", rest" (or nothing)
+#define EMBDL_CAT(a, b) EMBDL_CAT_(a, b)
+#define EMBDL_CAT_(a, b) a##b
+#define EMBDL_MULTIPLE(...) EMBDL_SIXTEENTH(__VA_ARGS__, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0)
+#define EMBDL_SIXTEENTH(_1, _2, _3, _4, _5, _6, _7, _8, _9, _10, _11, _12, _13, _14, _15, _16, ...) _16
+#define EMBDL_REST(...) EMBDL_CAT(EMBDL_REST_, EMBDL_MULTIPLE(__VA_ARGS__))(__VA_ARGS__)
+#define EMBDL_REST_0(first)
+#define EMBDL_REST_1(first, ...) , __VA_ARGS__
+
+// Turns ("format", args...) into (EMBDL_FMT("format"), args...)
+#define EMBDL_FMT_ARGS(...) EMBDL_FMT(EMBDL_FIRST(__VA_ARGS__)) EMBDL_REST(__VA_ARGS__)
+
+namespace EmbedLog
+{
+    /**
+     * @struct FormatItem
+     * @brief A run of literal text, optionally followed by an argument.
+     */
+    struct FormatItem
+    {
+        uint16_t offset = 0;    // Start of the text in the format string.
+        uint16_t length = 0;    // Length of the text.
+        int16_t arg = -1;       // Index of the argument that follows, or -1 for none.
+        char spec = '\0';       // 'x' or 'X' for hex, '.' for fixed precision, or '\0'.
+        uint8_t precision = 0;  // Decimal places when spec is '.'.
+    };
+
+    /**
+     * @struct BraceDescriptor
+     * @brief A parsed brace format string.
+     */
+    struct BraceDescriptor
+    {
+        const char* text;        // The format string.
+        const FormatItem* items; // Parsed text and argument segments.
+        size_t count;            // Number of items.
+        size_t args;             // Number of arguments expected.
+    };
+
+    // Compile-Time Parsing
+    constexpr size_t count_format_items(const char* text)
+    {
+        size_t count = 1;
+        for (; *text; ++text)
+        {
+            if (*text == '{' || *text == '}')
+                ++count;
+        }
+        return count;
+    }
+
+    template <size_t N>
+    struct ParsedFormat
+    {
+        FormatItem items[N] = {};
+        size_t count = 0;
+        size_t args = 0;
+        bool valid = true;
+    };
+
+    template <size_t N>
+    constexpr ParsedFormat<N> parse_format(const char* text)
+    {
+        ParsedFormat<N> parsed;
+        size_t position = 0;
+        size_t start = 0;
+        while (text[position])
+        {
+            char c = text[position];
+            if (c != '{' && c != '}')
+            {
+                ++position;
+                continue;
+            }
+
+            FormatItem& item = parsed.items[parsed.count++];
+            item.offset = static_cast<uint16_t>(start);
+            item.length = static_cast<uint16_t>(position - start);
+
+            // Escaped braces end the text just after the first brace
+            if (text[position + 1] == c)
+            {
+                item.length += 1;
+                position += 2;
+                start = position;
+                continue;
+            }
+
+            if (c == '}')
+            {
+                parsed.valid = false;
+                return parsed;
+            }
+
+            ++position;
+            if (text[position] == ':')
+            {
+                ++position;
+                if (text[position] == 'x' || text[position] == 'X')
+                    item.spec = text[position++];
+                else if (text[position] == '.' && text[position + 1] >= '0' && text[position + 1] <= '9')
+                {
+                    item.spec = '.';
+                    ++position;
+                    while (text[position] >= '0' && text[position] <= '9')
+                        item.precision = static_cast<uint8_t>(item.precision * 10 + (text[position++] - '0'));
+                }
+            }
+
+            if (text[position] != '}')
+            {
+                parsed.valid = false;
+                return parsed;
+            }
+
+            item.arg = static_cast<int16_t>(parsed.args++);
+            start = ++position;
+        }
+
+        FormatItem& last = parsed.items[parsed.count++];
+        last.offset = static_cast<uint16_t>(start);
+        last.length = static_cast<uint16_t>(position - start);
+        return parsed;
+    }
+
+    /**
+     * @struct BraceFormat
+     * @brief A brace format string parsed at compile time. Created with EMBDL_FMT.
+     */
+    template <typename Source>
+    struct BraceFormat
+    {
+        static constexpr const char* text = Source::value();
+        static constexpr ParsedFormat<count_format_items(text)> parsed = parse_format<count_format_items(text)>(text);
+        static_assert(parsed.valid, "EmbedLog: malformed {} format string");
+        static constexpr BraceDescriptor descriptor{text, parsed.items, parsed.count, parsed.args};
+
+        /**
+         * @brief Checks that a list of argument types suits the placeholders.
+         *
+         * @return True if there is one argument per placeholder and each suits its spec.
+         */
+        template <typename... Args>
+        static constexpr bool check()
+        {
+            if (sizeof...(Args) != parsed.args)
+                return false;
+
+            constexpr ArgClass classes[] = {arg_class<Args>()..., ArgClass::END};
+            for (size_t i = 0; i < parsed.count; ++i)
+            {
+                const FormatItem& item = parsed.items[i];
+                if (item.arg < 0)
+                    continue;
+                if ((item.spec == 'x' || item.spec == 'X') && classes[item.arg] != ArgClass::INTEGER)
+                    return false;
+                if (item.spec == '.' && classes[item.arg] != ArgClass::FLOATING)
+                    return false;
+            }
+            return true;
+        }
+    };
+
+    /**
+     * @brief Formats arguments using a parsed brace format.
+     *
+     * @param out The string to append the message to.
+     * @param format The parsed format.
+     * @param args The arguments.
+     * @param count The number of arguments.
+     */
+    void render_braces(std::string& out, const BraceDescriptor& format, const ArgValue* args, size_t count);
+
+    /**
+     * @brief Formats captured arguments using a parsed brace format.
+     *
+     * @param out The string to append the message to.
+     * @param format The parsed format.
+     * @param args The captured arguments.
+     * @param size The number of bytes of captured arguments.
+     */
+    void render_braces(std::string& out, const BraceDescriptor& format, const uint8_t* args, size_t size);
+
+    /**
+     * @brief Formats arguments using a brace format made with EMBDL_FMT.
+     *
+     * @param out The string to append the message to.
+     * @param format The format.
+     * @param args The arguments, checked against the format at compile time.
+     */
+    template <typename Source, typename... Args>
+    void format_to(std::string& out, BraceFormat<Source>, const Args&... args)
+    {
+        static_assert(BraceFormat<Source>::template check<Args...>(), "EmbedLog: format string does not match its arguments");
+        detail::with_arg_values([&out](const ArgValue* values, size_t count) {
+            render_braces(out, BraceFormat<Source>::descriptor, values, count);
+        }, args...);
+    }
+} // namespace EmbedLog
@@ -0,0 +1,298 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Buffers provides argument wrappers for logging byte buffers as hex, and
+ * numeric arrays and ranges with an element limit. Each wrapper is formatted
+ * in a single write to the message, and is captured as raw bytes when
+ * logging is deferred, so the hex or decimal text is only produced on flush.
+ *
+ */
+
+
+#pragma once
+
+#include "EmbedLog/Formatter.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <string>
+#include <type_traits>
+
+namespace EmbedLog
+{
+    /**
+     * @brief Appends bytes to a string as lowercase hex.
+     *
+     * @param out The string to append to.
+     * @param data The bytes to encode.
+     * @param size The number of bytes.
+     * @param separator A character to put between bytes, or '\0' for none.
+     *
+     * @note The string is grown once, then encoded in place 16 bytes at a time, with or
+     * without a separator: SSE2 on x86-64, plus SSSE3 shuffles for separators when the CPU
+     * has them, and NEON on AArch64.
+     */
+    void append_hex(std::string& out, const uint8_t* data, size_t size, char separator = '\0');
+
+    /**
+     * @struct HexBytes
+     * @brief A byte buffer to be logged as hex. Created with hex().
+     */
+    struct HexBytes
+    {
+        const uint8_t* data;  // Bytes to log.
+        size_t size;          // Number of bytes in the buffer.
+        size_t limit;         // Maximum number of bytes to show.
+        char separator;       // Character between bytes, or '\0' for none.
+    };
+
+    /**
+     * @brief Wraps a byte buffer to be logged as hex with %s.
+     *
+     * @param data The bytes to log.
+     * @param size The number of bytes in the buffer.
+     * @param limit The maximum number of bytes to show. The rest are counted, not shown.
+     * @param separator A character to put between bytes, or '\0' for none.
+     * @return An argument for log_format or log_deferred.
+     */
+    inline HexBytes hex(const void* data, size_t size, size_t limit = 64, char separator = ' ')
+    {
+        return HexBytes{static_cast<const uint8_t*>(data), size, limit, separator};
+    }
+
+    namespace detail
+    {
+        template <typename Range, typename = void>
+        struct is_contiguous : std::false_type {};
+
+        template <typename Range>
+        struct is_contiguous<Range, std::void_t<decltype(std::data(std::declval<const Range&>()))>>
+            : std::is_pointer<decltype(std::data(std::declval<const Range&>()))> {};
+    }
+
+    /**
+     * @struct ArrayView
+     * @brief A numeric array to be logged as a list. Created with array() or range().
+     */
+    template <typename T>
+    struct ArrayView
+    {
+        static_assert(std::is_arithmetic<T>::value, "EmbedLog: arrays must hold numbers");
+
+        const T* data;   // Elements to log.
+        size_t size;     // Number of elements in the array.
+        size_t limit;    // Maximum number of elements to show.
+    };
+
+    /**
+     * @brief Wraps a numeric array to be logged as a list with %s.
+     *
+     * @param data The elements to log.
+     * @param size The number of elements.
+     * @param limit The maximum number of elements to show. The rest are counted, not shown.
+     * @return An argument for log_format or log_deferred.
+     */
+    template <typename T>
+    ArrayView<T> array(const T* data, size_t size, size_t limit = 16)
+    {
+        return ArrayView<T>{data, size, limit};
+    }
+
+    /**
+     * @struct RangeView
+     * @brief A range of numbers to be logged as a list. Created with range().
+     */
+    template <typename Range>
+    struct RangeView
+    {
+        const Range* range;  // Range to log.
+        size_t limit;        // Maximum number of elements to show.
+    };
+
+    /**
+     * @brief Wraps a range of numbers, such as a std::list, to be logged as a list with %s.
+     *
+     * @param range The range to log. Contiguous ranges are logged as arrays.
+     * @param limit The maximum number of elements to show. The rest are counted, not shown.
+     * @return An argument for log_format or log_deferred.
+     */
+    template <typename Range>
+    auto range(const Range& range, size_t limit = 16)
+    {
+        using Element = std::decay_t<decltype(*std::begin(range))>;
+        if constexpr (detail::is_contiguous<Range>::value)
+            return ArrayView<Element>{std::data(range), static_cast<size_t>(std::size(range)), limit};
+        else
+            return RangeView<Range>{&range, limit};
+    }
+
+    namespace detail
+    {
+        // Shared by the formatters for arrays and ranges
+        void append_number(std::string& out, int64_t value);
+        void append_number(std::string& out, uint64_t value);
+        void append_number(std::string& out, double value);
+        void append_more(std::string& out, size_t hidden);
+
+        template <typename T>
+        void append_element(std::string& out, T value)
+        {
+            if constexpr (std::is_floating_point<T>::value)
+                append_number(out, static_cast<double>(value));
+            else if constexpr (std::is_signed<T>::value)
+                append_number(out, static_cast<int64_t>(value));
+            else
+                append_number(out, static_cast<uint64_t>(value));
+        }
+
+        // Arrays and ranges are captured as a total element count followed by the shown elements
+        template <typename T, typename Iterator>
+        void encode_elements(uint8_t* out, Iterator first, size_t shown, size_t total)
+        {
+            uint32_t count = static_cast<uint32_t>(total);
+            std::memcpy(out, &count, sizeof(count));
+            out += sizeof(count);
+            for (size_t i = 0; i < shown; ++i, ++first)
+            {
+                T value = *first;
+                std::memcpy(out, &value, sizeof(T));
+                out += sizeof(T);
+            }
+        }
+
+        template <typename T>
+        void decode_elements(std::string& out, const uint8_t* data, size_t size)
+        {
+            uint32_t total;
+            std::memcpy(&total, data, sizeof(total));
+            size_t shown = (size - sizeof(total)) / sizeof(T);
+            data += sizeof(total);
+
+            out += '[';
+            for (size_t i = 0; i < shown; ++i)
+            {
+                T value;
+                std::memcpy(&value, data + i * sizeof(T), sizeof(T));
+                if (i != 0)
+                    out += ", ";
+                append_element(out, value);
+            }
+            append_more(out, total - shown);
+            out += ']';
+        }
+    }
+
+    template <>
+    struct Formatter<HexBytes>
+    {
+        static void format(std::string& out, const HexBytes& bytes);
+        static size_t size(const HexBytes& bytes);
+        static void encode(uint8_t* out, const HexBytes& bytes);
+        static void decode(std::string& out, const uint8_t* data, size_t size);
+    };
+
+    template <typename T>
+    struct Formatter<ArrayView<T>>
+    {
+        static void format(std::string& out, const ArrayView<T>& view)
+        {
+            size_t shown = view.size < view.limit ? view.size : view.limit;
+            out += '[';
+            for (size_t i = 0; i < shown; ++i)
+            {
+                if (i != 0)
+                    out += ", ";
+                detail::append_element(out, view.data[i]);
+            }
+            detail::append_more(out, view.size - shown);
+            out += ']';
+        }
+
+        static size_t size(const ArrayView<T>& view)
+        {
+            size_t shown = view.size < view.limit ? view.size : view.limit;
+            return sizeof(uint32_t) + shown * sizeof(T);
+        }
+
+        static void encode(uint8_t* out, const ArrayView<T>& view)
+        {
+            size_t shown = view.size < view.limit ? view.size : view.limit;
+            detail::encode_elements<T>(out, view.data, shown, view.size);
+        }
+
+        static void decode(std::string& out, const uint8_t* data, size_t size)
+        {
+            detail::decode_elements<T>(out, data, size);
+        }
+    };
+
+    template <typename Range>
+    struct Formatter<RangeView<Range>>
+    {
+        using Element = std::decay_t<decltype(*std::begin(std::declval<const Range&>()))>;
+        static_assert(std::is_arithmetic<Element>::value, "EmbedLog: ranges must hold numbers");
+
+        static size_t count(const RangeView<Range>& view)
+        {
+            return static_cast<size_t>(std::distance(std::begin(*view.range), std::end(*view.range)));
+        }
+
+        static void format(std::string& out, const RangeView<Range>& view)
+        {
+            size_t shown = 0;
+            size_t total = 0;
+            out += '[';
+            for (const auto& value : *view.range)
+            {
+                if (shown < view.limit)
+                {
+                    if (shown != 0)
+                        out += ", ";
+                    detail::append_element(out, value);
+                    ++shown;
+                }
+                ++total;
+            }
+            detail::append_more(out, total - shown);
+            out += ']';
+        }
+
+        static size_t size(const RangeView<Range>& view)
+        {
+            size_t total = count(view);
+            return sizeof(uint32_t) + (total < view.limit ? total : view.limit) * sizeof(Element);
+        }
+
+        static void encode(uint8_t* out, const RangeView<Range>& view)
+        {
+            size_t total = count(view);
+            detail::encode_elements<Element>(out, std::begin(*view.range), total < view.limit ? total : view.limit, total);
+        }
+
+        static void decode(std::string& out, const uint8_t* data, size_t size)
+        {
+            detail::decode_elements<Element>(out, data, size);
+        }
+    };
+} // namespace EmbedLog
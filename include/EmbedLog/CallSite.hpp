@@ -0,0 +1,110 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * CallSite holds the per call site state used by the EMBDL_* logging macros,
+ * including a run-time enable flag and a call counter, and keeps a registry
+ * so call sites can be switched on and off by file and line.
+ *
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+namespace EmbedLog
+{
+    using CallSiteCounter = std::atomic<uint32_t>;
+
+    /**
+     * @class CallSite
+     * @brief The state of a single logging statement.
+     *
+     * A CallSite is created as a function-local static by the EMBDL_* macros the first
+     * time the statement is reached, and registers itself so it can be enabled or
+     * disabled at run-time with set_call_site_enabled.
+     */
+    class CallSite
+    {
+    public:
+        /**
+         * @brief Constructs and registers a new CallSite.
+         *
+         * @param file The source file of the call site, usually __FILE__.
+         * @param line The source line of the call site, usually __LINE__.
+         */
+        CallSite(const char* file, int line);
+
+        CallSite(const CallSite&) = delete;
+        CallSite& operator=(const CallSite&) = delete;
+
+        /**
+         * @brief Checks whether the call site is enabled.
+         *
+         * @return True if messages from this call site may be logged.
+         */
+        bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief Enables or disables the call site.
+         *
+         * @param value True to enable the call site, false to disable it.
+         */
+        void setEnabled(bool value) { enabled.store(value, std::memory_order_relaxed); }
+
+        /**
+         * @brief Gets an identifier for this call site, suitable for throttling.
+         *
+         * @return An identifier that is unique for the life of the program.
+         */
+        size_t id() const { return reinterpret_cast<size_t>(this); }
+
+        const char* const file;         // Source file of the call site.
+        const int line;                 // Source line of the call site.
+        CallSiteCounter counter{0};     // Number of times the call site has passed its level check.
+
+    private:
+        std::atomic<bool> enabled{true};  // Run-time enable flag.
+        CallSite* next = nullptr;         // Next call site in the registry.
+
+        friend void set_call_site_enabled(const char* file, int line, bool enabled);
+    };
+
+    /**
+     * @brief Enables or disables logging statements by location.
+     *
+     * @param file The source file to match. Matches any __FILE__ ending with this string
+     *             at a path separator, so "foo.cpp" matches "src/foo.cpp" but not "barfoo.cpp".
+     * @param line The source line to match, or 0 to match every line in the file.
+     * @param enabled True to enable the matching call sites, false to disable them.
+     *
+     * @note The setting also applies to matching call sites that have not been reached yet.
+     *       Setting the same file and line again replaces the earlier setting, and only the
+     *       256 most recent settings are kept for call sites not reached yet.
+     */
+    void set_call_site_enabled(const char* file, int line, bool enabled);
+
+    // Counter Checks for Call Sites
+    bool accept_every_n(CallSiteCounter& counter, uint32_t n);
+    bool accept_first_n(CallSiteCounter& counter, uint32_t n);
+} // namespace EmbedLog
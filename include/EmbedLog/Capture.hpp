@@ -0,0 +1,395 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Capture encodes log arguments into compact, self-describing bytes so a
+ * message can be formatted later. String literals are kept by pointer, run-
+ * time strings are copied, user types serialise themselves through the
+ * Serializer trait, and format strings are checked against their arguments
+ * at compile time.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Format Checking
+// Expands to a static_assert that the first argument is a string literal whose
+// conversions match the types of the remaining arguments.
+#define EMBDL_FIRST(...) EMBDL_FIRST_(__VA_ARGS__, 0)
+#define EMBDL_FIRST_(first, ...) first
+#define EMBDL_CHECK_FORMAT(...)                                                                 \
+    static_assert(::EmbedLog::check_format("" EMBDL_FIRST(__VA_ARGS__),                         \
+                                           decltype(::EmbedLog::arg_types(__VA_ARGS__)){}),     \
+                  "EmbedLog: format string does not match its arguments")
+
+namespace EmbedLog
+{
+    // Types of Captured Arguments
+    enum class ArgType : uint8_t { INT32, UINT32, INT64, UINT64, DOUBLE, POINTER, STATIC_STRING, STRING, CUSTOM };
+
+    // Function Type for Rendering Captured User Types
+    using RenderFunction = void (*)(std::string& out, const uint8_t* data, size_t size);
+
+    /**
+     * @struct StaticString
+     * @brief A string that lives for the whole program, captured by pointer.
+     *
+     * Use literal("...") to pass a string literal as an argument without copying it.
+     */
+    struct StaticString
+    {
+        const char* text;
+    };
+
+    template <size_t N>
+    constexpr StaticString literal(const char (&text)[N])
+    {
+        return StaticString{text};
+    }
+
+    /**
+     * @struct Serializer
+     * @brief Describes how a value of type T is captured.
+     *
+     * Each specialisation provides the ArgType it is captured as, the number of bytes it
+     * needs and a function to write those bytes. To capture a user type, specialise
+     * Serializer with type ArgType::CUSTOM and add a render function that appends the
+     * decoded value to a string. Custom types match the %s conversion.
+     *
+     * Specialising Formatter is usually simpler, as it also covers formatting immediately.
+     *
+     * @code
+     * template <>
+     * struct EmbedLog::Serializer<Point>
+     * {
+     *     static constexpr ArgType type = ArgType::CUSTOM;
+     *     static size_t size(const Point&) { return sizeof(Point); }
+     *     static void encode(uint8_t* out, const Point& p) { memcpy(out, &p, sizeof(p)); }
+     *     static void render(std::string& out, const uint8_t* data, size_t size);
+     * };
+     * @endcode
+     */
+    template <typename T, typename Enable = void>
+    struct Serializer;
+
+    template <typename T, typename Stored, ArgType Type>
+    struct FixedSerializer
+    {
+        static constexpr ArgType type = Type;
+        static size_t size(const T&) { return sizeof(Stored); }
+        static void encode(uint8_t* out, const T& value)
+        {
+            Stored stored = static_cast<Stored>(value);
+            std::memcpy(out, &stored, sizeof(stored));
+        }
+    };
+
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_integral<T>::value && std::is_signed<T>::value && sizeof(T) <= 4>>
+        : FixedSerializer<T, int32_t, ArgType::INT32> {};
+
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_integral<T>::value && !std::is_signed<T>::value && sizeof(T) <= 4>>
+        : FixedSerializer<T, uint32_t, ArgType::UINT32> {};
+
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_integral<T>::value && std::is_signed<T>::value && (sizeof(T) > 4)>>
+        : FixedSerializer<T, int64_t, ArgType::INT64> {};
+
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_integral<T>::value && !std::is_signed<T>::value && (sizeof(T) > 4)>>
+        : FixedSerializer<T, uint64_t, ArgType::UINT64> {};
+
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_enum<T>::value>>
+    {
+        using Underlying = std::underlying_type_t<T>;
+        static constexpr ArgType type = Serializer<Underlying>::type;
+        static size_t size(const T& value) { return Serializer<Underlying>::size(static_cast<Underlying>(value)); }
+        static void encode(uint8_t* out, const T& value) { Serializer<Underlying>::encode(out, static_cast<Underlying>(value)); }
+    };
+
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_floating_point<T>::value>>
+        : FixedSerializer<T, double, ArgType::DOUBLE> {};
+
+    template <typename T>
+    struct Serializer<T*>
+    {
+        static constexpr ArgType type = ArgType::POINTER;
+        static size_t size(const T*) { return sizeof(uintptr_t); }
+        static void encode(uint8_t* out, const T* value)
+        {
+            uintptr_t address = reinterpret_cast<uintptr_t>(value);
+            std::memcpy(out, &address, sizeof(address));
+        }
+    };
+
+    template <>
+    struct Serializer<StaticString>
+    {
+        static constexpr ArgType type = ArgType::STATIC_STRING;
+        static size_t size(const StaticString&) { return sizeof(const char*); }
+        static void encode(uint8_t* out, const StaticString& value) { std::memcpy(out, &value.text, sizeof(value.text)); }
+    };
+
+    template <>
+    struct Serializer<std::string_view>
+    {
+        static constexpr ArgType type = ArgType::STRING;
+        static size_t size(std::string_view value) { return value.size() + 1; }
+        static void encode(uint8_t* out, std::string_view value)
+        {
+            std::memcpy(out, value.data(), value.size());
+            out[value.size()] = '\0';
+        }
+    };
+
+    template <>
+    struct Serializer<std::string> : Serializer<std::string_view> {};
+
+    template <>
+    struct Serializer<const char*>
+    {
+        static constexpr ArgType type = ArgType::STRING;
+        static std::string_view view(const char* value) { return value ? std::string_view(value) : std::string_view("(null)"); }
+        static size_t size(const char* value) { return Serializer<std::string_view>::size(view(value)); }
+        static void encode(uint8_t* out, const char* value) { Serializer<std::string_view>::encode(out, view(value)); }
+    };
+
+    template <>
+    struct Serializer<char*> : Serializer<const char*> {};
+
+    /**
+     * @brief Gets the number of bytes needed to capture a value.
+     *
+     * @param value The value to capture.
+     * @return The number of bytes, including the type tag.
+     */
+    template <typename T>
+    size_t capture_size(const T& value)
+    {
+        using S = Serializer<std::decay_t<T>>;
+        size_t size = 1 + S::size(value);
+        if (S::type == ArgType::STRING || S::type == ArgType::CUSTOM)
+            size += sizeof(uint32_t);
+        if (S::type == ArgType::CUSTOM)
+            size += sizeof(RenderFunction);
+        return size;
+    }
+
+    /**
+     * @brief Captures a value.
+     *
+     * @param out Where to write the value. Must have room for capture_size(value) bytes.
+     * @param value The value to capture.
+     * @return A pointer just past the captured bytes.
+     */
+    template <typename T>
+    uint8_t* capture(uint8_t* out, const T& value)
+    {
+        using S = Serializer<std::decay_t<T>>;
+        *out++ = static_cast<uint8_t>(S::type);
+        if constexpr (S::type == ArgType::CUSTOM)
+        {
+            RenderFunction render = &S::render;
+            std::memcpy(out, &render, sizeof(render));
+            out += sizeof(render);
+        }
+
+        uint32_t size = static_cast<uint32_t>(S::size(value));
+        if constexpr (S::type == ArgType::STRING || S::type == ArgType::CUSTOM)
+        {
+            std::memcpy(out, &size, sizeof(size));
+            out += sizeof(size);
+        }
+
+        S::encode(out, value);
+        return out + size;
+    }
+
+    /**
+     * @struct ArgValue
+     * @brief A single argument ready to be formatted.
+     *
+     * ArgValues either point at a live argument, when formatting immediately, or into
+     * captured bytes, when formatting a deferred message.
+     */
+    struct ArgValue
+    {
+        ArgType type;
+        union
+        {
+            int64_t i;
+            uint64_t u;
+            double d;
+            const void* p;
+        } value;                        // Value of numbers and pointers.
+        const char* text = nullptr;     // Characters of strings, or the data of user types.
+        size_t size = 0;                // Length of strings, or the size of user type data.
+        RenderFunction render = nullptr; // Formats user types.
+    };
+
+    // Maximum Number of Arguments Formatted from a Captured Message
+    constexpr size_t MAX_ARGS = 32;
+
+    /**
+     * @brief Reads captured arguments back into ArgValues.
+     *
+     * @param data The captured arguments.
+     * @param size The number of bytes of captured arguments.
+     * @param args Where to store the decoded arguments.
+     * @param count The maximum number of arguments to decode.
+     * @return The number of arguments decoded.
+     */
+    size_t decode_args(const uint8_t* data, size_t size, ArgValue* args, size_t count);
+
+    /**
+     * @brief Formats arguments using a printf style format string.
+     *
+     * @param out The string to append the message to.
+     * @param format The format string.
+     * @param args The arguments.
+     * @param count The number of arguments.
+     *
+     * @note Length modifiers in the format are ignored, as each argument carries its own
+     * type. An argument that does not suit its conversion is printed in its default form.
+     */
+    void render_format(std::string& out, const char* format, const ArgValue* args, size_t count);
+
+    /**
+     * @brief Formats captured arguments using a printf style format string.
+     *
+     * @param out The string to append the message to.
+     * @param format The format string.
+     * @param args The captured arguments.
+     * @param size The number of bytes of captured arguments.
+     */
+    void render_format(std::string& out, const char* format, const uint8_t* args, size_t size);
+
+    // Compile-Time Format Checking
+    template <typename... Args>
+    struct TypeList {};
+
+    template <typename... Args>
+    TypeList<Args...> arg_types(const Args&...);
+
+    enum class ArgClass : uint8_t { INTEGER, FLOATING, STRING, POINTER, END };
+
+    template <typename T>
+    constexpr ArgClass arg_class()
+    {
+        constexpr ArgType type = Serializer<std::decay_t<T>>::type;
+        switch (type)
+        {
+        case ArgType::DOUBLE:
+            return ArgClass::FLOATING;
+        case ArgType::POINTER:
+            return ArgClass::POINTER;
+        case ArgType::STATIC_STRING:
+        case ArgType::STRING:
+        case ArgType::CUSTOM:
+            return ArgClass::STRING;
+        default:
+            return ArgClass::INTEGER;
+        }
+    }
+
+    constexpr bool check_format(const char* format, const ArgClass* args)
+    {
+        while (*format)
+        {
+            if (*format++ != '%')
+                continue;
+            if (*format == '%')
+            {
+                ++format;
+                continue;
+            }
+
+            // Flags, width, precision and length modifiers
+            while (*format == '-' || *format == '+' || *format == ' ' || *format == '#' || *format == '0')
+                ++format;
+            if (*format == '*' && *args++ != ArgClass::INTEGER)
+                return false;
+            while ((*format >= '0' && *format <= '9') || *format == '*')
+                ++format;
+            if (*format == '.')
+            {
+                ++format;
+                if (*format == '*' && *args++ != ArgClass::INTEGER)
+                    return false;
+                while ((*format >= '0' && *format <= '9') || *format == '*')
+                    ++format;
+            }
+            while (*format == 'h' || *format == 'l' || *format == 'L' || *format == 'j' || *format == 'z' || *format == 't')
+                ++format;
+
+            ArgClass expected = ArgClass::END;
+            switch (*format)
+            {
+            case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+                expected = ArgClass::INTEGER;
+                break;
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+                expected = ArgClass::FLOATING;
+                break;
+            case 's':
+                expected = ArgClass::STRING;
+                break;
+            case 'p':
+                expected = ArgClass::POINTER;
+                break;
+            default:
+                return false;
+            }
+
+            if (*args++ != expected)
+                return false;
+            ++format;
+        }
+        return *args == ArgClass::END;
+    }
+
+    /**
+     * @brief Checks at compile time that a format string matches its arguments.
+     *
+     * @param format The format string.
+     * @return True if every conversion has an argument of a suitable type and there are
+     * no arguments left over.
+     *
+     * @note Used by EMBDL_CHECK_FORMAT, which passes the format itself as the first type.
+     */
+    template <typename Format, typename... Args>
+    constexpr bool check_format(const char* format, TypeList<Format, Args...>)
+    {
+        constexpr ArgClass args[] = {arg_class<Args>()..., ArgClass::END};
+        return check_format(format, args);
+    }
+} // namespace EmbedLog
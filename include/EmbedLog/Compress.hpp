@@ -0,0 +1,78 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Compress is a small LZ77 block compressor in the style of LZ4, used to
+ * keep more log history in the same RAM. It favours speed and a tiny
+ * footprint over ratio.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+namespace EmbedLog
+{
+    // Entries in the hash table compress_block works in, each a uint16_t
+    constexpr size_t COMPRESS_TABLE_SIZE = 1 << 10;
+
+    // The largest block compress_block accepts
+    constexpr size_t COMPRESS_MAX_BLOCK = 65535;
+
+    /**
+     * @brief Gets the most bytes compress_block can produce.
+     *
+     * @param size The number of bytes to compress.
+     * @return The worst case compressed size.
+     */
+    constexpr size_t compress_bound(size_t size)
+    {
+        return size + size / 255 + 16;
+    }
+
+    /**
+     * @brief Compresses a block of bytes.
+     *
+     * @param in The bytes to compress.
+     * @param size The number of bytes.
+     * @param out Where to write the compressed bytes.
+     * @param capacity The size of out.
+     * @param table Scratch space of COMPRESS_TABLE_SIZE entries, kept by the caller so
+     * compressing needs no stack or heap of its own.
+     * @return The compressed size, or 0 if it did not fit in capacity or size is over
+     * COMPRESS_MAX_BLOCK.
+     */
+    size_t compress_block(const uint8_t* in, size_t size, uint8_t* out, size_t capacity, uint16_t* table);
+
+    /**
+     * @brief Decompresses a block made by compress_block.
+     *
+     * @param in The compressed bytes.
+     * @param size The number of compressed bytes.
+     * @param out Where to write the original bytes.
+     * @param capacity The size of out.
+     * @return The original size, or 0 if the block is corrupt or too big for capacity.
+     */
+    size_t decompress_block(const uint8_t* in, size_t size, uint8_t* out, size_t capacity);
+}
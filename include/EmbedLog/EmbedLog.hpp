@@ -29,13 +29,100 @@
 
 #pragma once
 
-#include <unordered_map>
+#include "EmbedLog/Braces.hpp"
+#include "EmbedLog/Buffers.hpp"
+#include "EmbedLog/CallSite.hpp"
+#include "EmbedLog/Capture.hpp"
+#include "EmbedLog/FlashStore.hpp"
+#include "EmbedLog/FlightRecorder.hpp"
+#include "EmbedLog/Formatter.hpp"
+#include "EmbedLog/Hash.hpp"
+#include "EmbedLog/LineFormat.hpp"
+#include "EmbedLog/PersistentRegion.hpp"
+#include "EmbedLog/Probes.hpp"
+#include "EmbedLog/RecordRing.hpp"
+#include "EmbedLog/RenderPool.hpp"
+#include "EmbedLog/SinkQueue.hpp"
+#include "EmbedLog/ThrottleTable.hpp"
+#include "EmbedLog/Trace.hpp"
+
 #include <functional>
+#include <atomic>
+#include <memory>
 #include <string>
 #include <cstdint>
 #include <cstdarg>
+#include <charconv>
+#include <type_traits>
+#include <vector>
+
+#define EMBDLID std::integral_constant<uint64_t, EmbedLog::unique_id(__FILE__, __LINE__)>::value
+#define EMBDLCOUNTER ([]() -> EmbedLog::CallSiteCounter& { static EmbedLog::CallSiteCounter counter{0}; return counter; }())
+
+// Lazy Logging Macros
+// The arguments are only evaluated once the level, call site, and any throttle or
+// sampling checks have passed, and each argument is evaluated at most once. The
+// logger argument is a reference, not a pointer.
+#define EMBDL_LOG_CALL(logger, level, condition, call)                                 \
+    do                                                                                 \
+    {                                                                                  \
+        auto& embdl_logger = (logger);                                                 \
+        const ::EmbedLog::LogLevel embdl_level = (level);                              \
+        if (embdl_logger.isEnabled(embdl_level))                                       \
+        {                                                                              \
+            static ::EmbedLog::CallSite embdl_site(__FILE__, __LINE__);                \
+            if (embdl_site.isEnabled() && (condition))                                 \
+                embdl_logger.call;                                                     \
+        }                                                                              \
+    } while (0)
+
+#define EMBDL_LOG_IF(logger, level, condition, rate, ...) \
+    EMBDL_LOG_CALL(logger, level, condition, log_unchecked(embdl_level, rate, __VA_ARGS__))
+#define EMBDL_LOG(logger, level, ...) \
+    EMBDL_LOG_IF(logger, level, embdl_logger.acceptSample(), embdl_logger.getSampleRate(), __VA_ARGS__)
+#define EMBDL_LOG_THROTTLED(logger, throttle_ms, level, ...) \
+    EMBDL_LOG_IF(logger, level, embdl_logger.acceptThrottle(embdl_site.id(), throttle_ms), 1.0, __VA_ARGS__)
+#define EMBDL_LOG_THROTTLED_BY(logger, throttle_ms, key, level, ...) \
+    EMBDL_LOG_IF(logger, level, embdl_logger.acceptThrottle(::EmbedLog::content_id(nullptr, embdl_site.id(), key), throttle_ms), 1.0, __VA_ARGS__)
+#define EMBDL_LOG_SAMPLED(logger, rate, level, ...)                                    \
+    do                                                                                 \
+    {                                                                                  \
+        double embdl_rate;                                                             \
+        EMBDL_LOG_IF(logger, level, ::EmbedLog::accept_sample(embdl_rate = (rate)), embdl_rate, __VA_ARGS__); \
+    } while (0)
+#define EMBDL_LOG_EVERY_N(logger, n, level, ...) \
+    EMBDL_LOG_IF(logger, level, ::EmbedLog::accept_every_n(embdl_site.counter, n), 1.0, __VA_ARGS__)
+#define EMBDL_LOG_FIRST_N(logger, n, level, ...) \
+    EMBDL_LOG_IF(logger, level, ::EmbedLog::accept_first_n(embdl_site.counter, n), 1.0, __VA_ARGS__)
+#define EMBDL_LOG_ONCE(logger, level, ...) \
+    EMBDL_LOG_IF(logger, level, ::EmbedLog::accept_first_n(embdl_site.counter, 1), 1.0, __VA_ARGS__)
 
-#define EMBDLID EmbedLog::unique_id(__FILE__, __LINE__)
+// Type Checked Logging Macro
+// Checks the format against its arguments at compile time, then formats immediately.
+#define EMBDL_LOG_FORMAT(logger, level, ...)                                           \
+    do                                                                                 \
+    {                                                                                  \
+        EMBDL_CHECK_FORMAT(__VA_ARGS__);                                               \
+        EMBDL_LOG_CALL(logger, level, embdl_logger.acceptSample(), log_format_unchecked(embdl_level, embdl_logger.getSampleRate(), __VA_ARGS__)); \
+    } while (0)
+
+// Brace Format Logging Macros
+// Like EMBDL_LOG_FORMAT and EMBDL_LOG_DEFERRED, but the format uses {} placeholders
+// and is parsed and checked at compile time.
+#define EMBDL_LOG_FMT(logger, level, ...) \
+    EMBDL_LOG_CALL(logger, level, embdl_logger.acceptSample(), log_format_unchecked(embdl_level, embdl_logger.getSampleRate(), EMBDL_FMT_ARGS(__VA_ARGS__)))
+#define EMBDL_LOG_DEFERRED_FMT(logger, level, ...) \
+    EMBDL_LOG_CALL(logger, level, embdl_logger.acceptSample(), log_deferred_unchecked(embdl_level, embdl_logger.getSampleRate(), EMBDL_FMT_ARGS(__VA_ARGS__)))
+
+// Deferred Logging Macro
+// Checks the format against its arguments at compile time, then captures the
+// arguments for formatting by flush.
+#define EMBDL_LOG_DEFERRED(logger, level, ...)                                         \
+    do                                                                                 \
+    {                                                                                  \
+        EMBDL_CHECK_FORMAT(__VA_ARGS__);                                               \
+        EMBDL_LOG_CALL(logger, level, embdl_logger.acceptSample(), log_deferred_unchecked(embdl_level, embdl_logger.getSampleRate(), __VA_ARGS__)); \
+    } while (0)
 
 namespace EmbedLog
 {
@@ -44,13 +131,228 @@ namespace EmbedLog
     using CloseFunction = std::function<bool()>;
     using PrintFunction = std::function<void(const std::string&)>;
     using MicrosecondFunction = std::function<uint64_t()>;
-    using ThrottleMap = std::unordered_map<size_t, uint64_t>;
 
     // Log Levels
     enum LogLevel { INFO, WARNING, ERROR, DEBUG, NONE };
 
     // Unique Identifier for Throttling
-    uint64_t unique_id(std::string file, int line);
+    constexpr uint64_t unique_id(const char* file, int line)
+    {
+        return hash_mix(hash_string(file), static_cast<uint64_t>(line));
+    }
+
+    inline uint64_t unique_id(const std::string& file, int line)
+    {
+        return unique_id(file.c_str(), line);
+    }
+
+    // Random Sampling Check
+    bool accept_sample(double rate);
+
+    /**
+     * @struct Config
+     * @brief The immutable settings of a log.
+     *
+     * A Config is created once and shared between every log constructed from it, so
+     * creating many logs with the same callbacks only costs a reference count each.
+     */
+    struct Config
+    {
+        OpenFunction openFunc;                // Function for opening the log.
+        CloseFunction closeFunc;              // Function for closing the log.
+        PrintFunction printFunc;              // Function for printing log messages.
+        MicrosecondFunction microsecondFunc;  // Function for getting microsecond timestamps.
+        std::string name;                     // Log name.
+        std::string format;                   // Format for the timestamp.
+        LineFormat line;                      // Compiled form of format, made by EmbedLog when left empty.
+    };
+
+    using ConfigPointer = std::shared_ptr<const Config>;
+
+    class EmbedLog;
+    class LogBatch;
+
+    /**
+     * @class TraceSpan
+     * @brief Records the time taken by a scope as one complete trace event.
+     */
+    class TraceSpan
+    {
+    public:
+        /**
+         * @brief Starts a span.
+         *
+         * @param log The log to record to, or nullptr to do nothing.
+         * @param name A name for the span. It must be a string literal or otherwise outlive the log.
+         */
+        TraceSpan(EmbedLog* log, const char* name);
+
+        TraceSpan(TraceSpan&& other) noexcept;
+        TraceSpan(const TraceSpan&) = delete;
+        TraceSpan& operator=(const TraceSpan&) = delete;
+        TraceSpan& operator=(TraceSpan&&) = delete;
+
+        /**
+         * @brief Records the span.
+         */
+        ~TraceSpan();
+
+    private:
+        EmbedLog* log;     // Log to record to, or nullptr when not tracing.
+        const char* name;  // Name of the span.
+        uint64_t start;    // Clock reading when the span started.
+    };
+
+    /**
+     * @class RecordBuilder
+     * @brief Builds a message piece by piece, straight into the space it will be logged from.
+     *
+     * With a deferred buffer the text is written into a record reserved in the ring. Otherwise
+     * it is written into a line buffer reused by the thread, so no allocations are made once
+     * the buffer has grown. A builder that is destroyed without being committed logs nothing.
+     */
+    class RecordBuilder
+    {
+    public:
+        /**
+         * @brief Starts a message.
+         *
+         * @param log The log to write to, or nullptr to ignore everything written.
+         * @param level The log level of the message.
+         * @param capacity The most bytes of text a deferred record can hold.
+         */
+        RecordBuilder(EmbedLog* log, LogLevel level, size_t capacity);
+
+        RecordBuilder(RecordBuilder&& other) noexcept;
+        RecordBuilder(const RecordBuilder&) = delete;
+        RecordBuilder& operator=(const RecordBuilder&) = delete;
+        RecordBuilder& operator=(RecordBuilder&&) = delete;
+
+        /**
+         * @brief Discards the message if it was not committed.
+         */
+        ~RecordBuilder();
+
+        /**
+         * @brief Checks whether the message will be logged when committed.
+         */
+        bool isActive() const { return log != nullptr; }
+
+        /**
+         * @brief Appends bytes to the message.
+         *
+         * @param data The bytes to append.
+         * @param length The number of bytes.
+         *
+         * @note Text that does not fit in a deferred record is cut off.
+         */
+        void append(const char* data, size_t length);
+
+        /**
+         * @brief Gets space to write into directly.
+         *
+         * @param length The number of bytes wanted.
+         * @return A pointer to at least length writable bytes, or nullptr if there is no room.
+         *
+         * @note Call advance with the number of bytes actually written.
+         */
+        char* reserve(size_t length);
+
+        /**
+         * @brief Adds bytes written into the space from reserve to the message.
+         *
+         * @param length The number of bytes written.
+         */
+        void advance(size_t length);
+
+        /**
+         * @brief Logs the message.
+         */
+        void commit();
+
+        RecordBuilder& operator<<(const char* text);
+        RecordBuilder& operator<<(const std::string& text);
+        RecordBuilder& operator<<(char c);
+        RecordBuilder& operator<<(bool value);
+        RecordBuilder& operator<<(double value);
+
+        template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+        RecordBuilder& operator<<(T value)
+        {
+            char text[24];
+            append(text, std::to_chars(text, text + sizeof(text), value).ptr - text);
+            return *this;
+        }
+
+        template <typename T, std::enable_if_t<has_formatter<T>::value, int> = 0>
+        RecordBuilder& operator<<(const T& value)
+        {
+            if (log)
+            {
+                Formatter<T>::format(beginFormat(), value);
+                endFormat();
+            }
+            return *this;
+        }
+
+    private:
+        // Gets a buffer for a Formatter to append to: the line itself, or scratch space
+        // reused by the thread when the message goes to a deferred record
+        std::string& beginFormat();
+
+        // Adds what the Formatter appended to the message
+        void endFormat();
+
+        // Frees the record or line buffer without logging
+        void release();
+
+        EmbedLog* log;       // Log to write to, or nullptr when inactive.
+        uint8_t* record;     // Record reserved in the deferred buffer, or nullptr.
+        std::string* line;   // Line buffer when not deferred, or nullptr.
+        size_t size;         // Bytes of text written.
+        size_t capacity;     // Bytes of text a deferred record can hold.
+        uint64_t timestamp;  // Time the message was started.
+        LogLevel level;      // Log level of the message.
+    };
+
+    /**
+     * @class ScopedTimer
+     * @brief Logs how long a scope took when it ends, if it took long enough.
+     *
+     * The start time is read from the log's clock when the timer is created. When it
+     * is destroyed the elapsed time is compared with the threshold first, so scopes
+     * that finish quickly cost two clock reads and nothing else.
+     */
+    class ScopedTimer
+    {
+    public:
+        /**
+         * @brief Starts timing a scope.
+         *
+         * @param log The log to write to, or nullptr to do nothing.
+         * @param level The log level for the message.
+         * @param name A name for the scope. It must outlive the timer.
+         * @param threshold The shortest time in microseconds that is logged.
+         */
+        ScopedTimer(EmbedLog* log, LogLevel level, const char* name, uint64_t threshold);
+
+        ScopedTimer(ScopedTimer&& other) noexcept;
+        ScopedTimer(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(const ScopedTimer&) = delete;
+        ScopedTimer& operator=(ScopedTimer&&) = delete;
+
+        /**
+         * @brief Logs the elapsed time if it is at least the threshold.
+         */
+        ~ScopedTimer();
+
+    private:
+        EmbedLog* log;       // Log to write to, or nullptr when disabled.
+        const char* name;    // Name of the scope.
+        uint64_t start;      // Clock reading when the timer started.
+        uint64_t threshold;  // Shortest elapsed time that is logged.
+        LogLevel level;      // Log level for the message.
+    };
 
     /**
      * @class EmbedLog
@@ -83,6 +385,37 @@ namespace EmbedLog
                  std::string name, 
                  std::string format = "[%D:%H:%M:%S.%U %N %L] %T");
 
+        /**
+         * @brief Constructs a new EmbedLog object with a prepared line format.
+         *
+         * @param openFunc Function to be called when opening the log.
+         * @param closeFunc Function to be called when closing the log.
+         * @param printFunc Function to print log messages.
+         * @param microsecondFunc Function to retrieve the current time in microseconds.
+         * @param name A name for the log.
+         * @param line The line format, usually made with EMBDL_LINE_FORMAT so that
+         * its renderer is generated at compile time.
+         */
+        EmbedLog(OpenFunction openFunc,
+                 CloseFunction closeFunc,
+                 PrintFunction printFunc,
+                 MicrosecondFunction microsecondFunc,
+                 std::string name,
+                 LineFormat line);
+
+        /**
+         * @brief Constructs a new EmbedLog object from a shared configuration.
+         *
+         * @param config The configuration to use. It may be shared with other logs.
+         *
+         * @note This is the cheapest way to create many logs with the same settings,
+         * as nothing is copied beyond the shared pointer itself.
+         */
+        explicit EmbedLog(ConfigPointer config);
+
+        EmbedLog(const EmbedLog&) = delete;
+        EmbedLog& operator=(const EmbedLog&) = delete;
+
         /**
          * @brief Destroys the EmbedLog object.
          *
@@ -101,6 +434,8 @@ namespace EmbedLog
          * @brief Closes the log by calling the user-defined close function.
          *
          * @return True if the log was successfully closed, false otherwise.
+         *
+         * @note Deferred messages and trace events are flushed first, and the trace finished.
          */
         bool close();
 
@@ -113,6 +448,91 @@ namespace EmbedLog
          */
         void setLogLevel(LogLevel level);
 
+        /**
+         * @brief Sets the fraction of messages passed to log that are printed.
+         *
+         * @param rate The sample rate, from 0.0 (none) to 1.0 (all, the default).
+         *
+         * @note Sampled messages are tagged with the rate so counts can be re-weighted. The
+         * rate belongs to this log, not to its Config, so logs sharing a Config are sampled
+         * separately.
+         */
+        void setSampleRate(double rate);
+
+        /**
+         * @brief Gets the sample rate set by setSampleRate.
+         *
+         * @return The sample rate, from 0.0 to 1.0.
+         */
+        double getSampleRate() const;
+
+        /**
+         * @brief Checks whether a message at the given level would be logged.
+         *
+         * @param level The log level to check.
+         * @return True if the log is open and the level is high enough.
+         */
+        bool isEnabled(LogLevel level) const
+        {
+            bool enabled = isOpen && level >= logLevel;
+            EMBDL_PROBE2(log_entry, static_cast<int>(level), enabled);
+            return enabled;
+        }
+
+        /**
+         * @brief Draws against the sample rate set by setSampleRate.
+         *
+         * @return True if a message should be logged.
+         */
+        bool acceptSample();
+
+        /**
+         * @brief Checks and updates the throttle state for a message.
+         *
+         * @param throttle_id The unique identifier for the message.
+         * @param throttle_ms The minimum time in milliseconds between messages.
+         * @return True if a message should be logged, in which case the throttle is restarted.
+         *
+         * @note This is safe to call from several threads at once.
+         */
+        bool acceptThrottle(size_t throttle_id, uint32_t throttle_ms);
+
+        /**
+         * @brief Sets the maximum number of throttle IDs the log keeps track of.
+         *
+         * @param capacity The number of IDs, rounded up to a power of two. Defaults to 64.
+         *
+         * @note Changing the capacity discards the current throttle state, so it must not
+         * be called while other threads are logging. When the table is full, expired IDs
+         * are reclaimed first, then the least recently logged.
+         */
+        void setThrottleCapacity(size_t capacity);
+
+        /**
+         * @brief Enables or disables the per-thread cache of suppressed throttle IDs.
+         *
+         * @param enabled True to reject recently suppressed IDs without touching the shared
+         * throttle table. Enabled by default.
+         *
+         * @note Like setThrottleCapacity, this discards the current throttle state.
+         */
+        void setThrottleCacheEnabled(bool enabled);
+
+        /**
+         * @brief Gets the occupancy statistics of the throttle table.
+         *
+         * @return The statistics, all zero if no throttled message has been logged yet.
+         */
+        ThrottleStats getThrottleStats() const;
+
+        /**
+         * @brief Reclaims every throttle ID whose throttle window has passed.
+         *
+         * @note Expired IDs are also reclaimed lazily as new IDs arrive, so this is only
+         * needed to keep getThrottleStats reporting live IDs.
+         */
+        void expireThrottles();
+
         /**
          * @brief Logs a message if the specified log level is high enough.
          *
@@ -122,6 +542,19 @@ namespace EmbedLog
          */
         void log(LogLevel level, const std::string& format, ...);
 
+        /**
+         * @brief Logs a randomly sampled fraction of messages.
+         *
+         * @param rate The probability of a message being logged, from 0.0 to 1.0.
+         * @param level The log level for this message.
+         * @param format The format string for the message.
+         * @param ... The values to log.
+         *
+         * @note The decision is made with a per-thread random number generator before
+         * any formatting is done. Printed messages are tagged with the rate.
+         */
+        void log_sampled(double rate, LogLevel level, const std::string& format, ...);
+
         /**
          * @brief Logs a message if the specified log level is high enough.
          *
@@ -133,28 +566,751 @@ namespace EmbedLog
          */
         void log_throttled(size_t throttle_id, uint32_t throttle_ms, LogLevel level,  const std::string& format, ...);
 
+        /**
+         * @brief Logs a message, throttling identical messages together.
+         *
+         * @param throttle_ms The minimum time in milliseconds between identical messages.
+         * @param level The log level for this message.
+         * @param format The format string for the message.
+         * @param args The values to log. As for log_format, these may be std::strings or
+         * user types with a Formatter.
+         *
+         * @note The throttle ID is a hash of the format string's address and the argument
+         * values, built with content_id without rendering the message. Use
+         * EMBDL_LOG_THROTTLED_BY to throttle on selected arguments only.
+         */
+        template <typename... Args>
+        void log_throttled_content(uint32_t throttle_ms, LogLevel level, const char* format, const Args&... args)
+        {
+            if (!isEnabled(level) || !acceptThrottle(static_cast<size_t>(content_id(format, args...)), throttle_ms))
+                return;
+
+            log_format_unchecked(level, 1.0, format, args...);
+        }
+
+        /**
+         * @brief Logs every n-th message from a call site.
+         *
+         * @param counter The call site counter, usually EMBDLCOUNTER.
+         * @param n The number of calls per logged message. The first call is always logged.
+         * @param level The log level for this message.
+         * @param format The format string for the message.
+         * @param ... The values to log.
+         *
+         * @note Unlike log_throttled, no clock is read and no map is searched.
+         */
+        void log_every_n(CallSiteCounter& counter, uint32_t n, LogLevel level, const std::string& format, ...);
+
+        /**
+         * @brief Logs only the first n messages from a call site.
+         *
+         * @param counter The call site counter, usually EMBDLCOUNTER.
+         * @param n The number of messages to log before going quiet.
+         * @param level The log level for this message.
+         * @param format The format string for the message.
+         * @param ... The values to log.
+         */
+        void log_first_n(CallSiteCounter& counter, uint32_t n, LogLevel level, const std::string& format, ...);
+
+        /**
+         * @brief Logs only the first message from a call site.
+         *
+         * @param counter The call site counter, usually EMBDLCOUNTER.
+         * @param level The log level for this message.
+         * @param format The format string for the message.
+         * @param ... The values to log.
+         */
+        void log_once(CallSiteCounter& counter, LogLevel level, const std::string& format, ...);
+
+        /**
+         * @brief Logs a message without checking the level, throttle or sample rate.
+         *
+         * @param level The log level for this message.
+         * @param rate The sample rate the message passed, or 1.0 if it was not sampled.
+         * @param format The format string for the message.
+         * @param ... The values to log.
+         *
+         * @note This is used by the EMBDL_* macros once all checks have passed.
+         */
+        void log_unchecked(LogLevel level, double rate, const std::string& format, ...);
+
+        /**
+         * @brief Logs a message with typed arguments, formatted immediately.
+         *
+         * @param level The log level for this message.
+         * @param format The format string for the message.
+         * @param args The values to log. Unlike log, these may be std::strings or user
+         * types with a Formatter, which are written straight into the message.
+         *
+         * @note Use EMBDL_LOG_FORMAT to also check the format against the arguments at
+         * compile time.
+         */
+        template <typename... Args>
+        void log_format(LogLevel level, const char* format, const Args&... args)
+        {
+            if (!isEnabled(level))
+                return;
+
+            log_format_unchecked(level, 1.0, format, args...);
+        }
+
+        /**
+         * @brief Logs a message with typed arguments without checking the level or sample rate.
+         *
+         * @param level The log level for this message.
+         * @param rate The sample rate the message passed, or 1.0 if it was not sampled.
+         * @param format The format string for the message.
+         * @param args The values to log.
+         *
+         * @note This is used by the EMBDL_* macros once all checks have passed.
+         */
+        template <typename... Args>
+        void log_format_unchecked(LogLevel level, double rate, const char* format, const Args&... args)
+        {
+            EMBDL_PROBE1(format, static_cast<int>(level));
+            std::string message;
+            format_to(message, format, args...);
+            print(level, message, getTimestamp(), rate);
+        }
+
+        /**
+         * @brief Logs a message using a brace format, formatted immediately.
+         *
+         * @param level The log level for this message.
+         * @param format The format, made with EMBDL_FMT.
+         * @param args The values to log, checked against the format at compile time.
+         */
+        template <typename Source, typename... Args>
+        void log_format(LogLevel level, BraceFormat<Source> format, const Args&... args)
+        {
+            if (!isEnabled(level))
+                return;
+
+            log_format_unchecked(level, 1.0, format, args...);
+        }
+
+        /**
+         * @brief Logs a message using a brace format, without checking the level or sample rate.
+         *
+         * @param level The log level for this message.
+         * @param rate The sample rate the message passed, or 1.0 if it was not sampled.
+         * @param format The format, made with EMBDL_FMT.
+         * @param args The values to log, checked against the format at compile time.
+         *
+         * @note This is used by the EMBDL_* macros once all checks have passed.
+         */
+        template <typename Source, typename... Args>
+        void log_format_unchecked(LogLevel level, double rate, BraceFormat<Source> format, const Args&... args)
+        {
+            EMBDL_PROBE1(format, static_cast<int>(level));
+            std::string message;
+            format_to(message, format, args...);
+            print(level, message, getTimestamp(), rate);
+        }
+
+        /**
+         * @brief Captures a message to be formatted later by flush.
+         *
+         * @param level The log level for this message.
+         * @param format The format string for the message. It must outlive the call to flush,
+         * which any string literal does.
+         * @param args The values to log. Run-time strings are copied, so they may be freed
+         * straight away. Wrap string literals in literal() to store only their address.
+         *
+         * @note The timestamp is taken now. If deferred logging is not enabled the message
+         * is formatted and printed immediately. Use EMBDL_LOG_DEFERRED to also check the
+         * format against the arguments at compile time.
+         */
+        template <typename... Args>
+        void log_deferred(LogLevel level, const char* format, const Args&... args)
+        {
+            if (!isEnabled(level))
+                return;
+
+            log_deferred_unchecked(level, 1.0, format, args...);
+        }
+
+        /**
+         * @brief Captures a message without checking the level or sample rate.
+         *
+         * @param level The log level for this message.
+         * @param rate The sample rate the message passed, or 1.0 if it was not sampled. A
+         * lower rate is captured with the message and tagged onto it by flush.
+         * @param format The format string for the message.
+         * @param args The values to log.
+         *
+         * @note This is used by the EMBDL_* macros once all checks have passed.
+         */
+        template <typename... Args>
+        void log_deferred_unchecked(LogLevel level, double rate, const char* format, const Args&... args)
+        {
+            if (!records)
+            {
+                log_format_unchecked(level, rate, format, args...);
+                return;
+            }
+
+            if (rate < 1.0)
+                capture(DeferredRecord{getTimestamp(), format, 0, static_cast<uint16_t>(level), FORMAT_PRINTF | FORMAT_SAMPLED}, args..., rate);
+            else
+                capture(DeferredRecord{getTimestamp(), format, 0, static_cast<uint16_t>(level), FORMAT_PRINTF}, args...);
+        }
+
+        /**
+         * @brief Captures a message using a brace format, to be formatted later by flush.
+         *
+         * @param level The log level for this message.
+         * @param format The format, made with EMBDL_FMT.
+         * @param args The values to log, checked against the format at compile time.
+         */
+        template <typename Source, typename... Args>
+        void log_deferred(LogLevel level, BraceFormat<Source> format, const Args&... args)
+        {
+            if (!isEnabled(level))
+                return;
+
+            log_deferred_unchecked(level, 1.0, format, args...);
+        }
+
+        /**
+         * @brief Captures a message using a brace format, without checking the level or
+         * sample rate.
+         *
+         * @param level The log level for this message.
+         * @param rate The sample rate the message passed, or 1.0 if it was not sampled.
+         * @param format The format, made with EMBDL_FMT.
+         * @param args The values to log, checked against the format at compile time.
+         *
+         * @note This is used by the EMBDL_* macros once all checks have passed.
+         */
+        template <typename Source, typename... Args>
+        void log_deferred_unchecked(LogLevel level, double rate, BraceFormat<Source> format, const Args&... args)
+        {
+            static_assert(BraceFormat<Source>::template check<Args...>(), "EmbedLog: format string does not match its arguments");
+
+            if (!records)
+            {
+                log_format_unchecked(level, rate, format, args...);
+                return;
+            }
+
+            const void* descriptor = &BraceFormat<Source>::descriptor;
+            if (rate < 1.0)
+                capture(DeferredRecord{getTimestamp(), descriptor, 0, static_cast<uint16_t>(level), FORMAT_BRACES | FORMAT_SAMPLED}, args..., rate);
+            else
+                capture(DeferredRecord{getTimestamp(), descriptor, 0, static_cast<uint16_t>(level), FORMAT_BRACES}, args...);
+        }
+
+        /**
+         * @brief Chooses between reading the clock for every message and a cached time.
+         *
+         * @param enabled True to stamp messages with the time saved by updateClock, which
+         * flush calls, rather than calling the microsecond function each time.
+         *
+         * @note Scoped timers and trace events always read the clock, as they measure durations.
+         */
+        void setCoarseClock(bool enabled);
+
+        /**
+         * @brief Saves the current time for the coarse clock.
+         *
+         * @note Called by flush. Call it from a periodic timer or interrupt to set the
+         * coarse clock's resolution independently of flushing.
+         */
+        void updateClock();
+
+        /**
+         * @brief Gets the time to stamp a new message with.
+         *
+         * @return The cached time when the coarse clock is enabled, otherwise the current time.
+         */
+        uint64_t getTimestamp() const
+        {
+            return coarseClock ? coarseTime.load(std::memory_order_relaxed) : config->microsecondFunc();
+        }
+
+        /**
+         * @brief Enables deferred logging.
+         *
+         * @param capacity The number of bytes to hold captured messages in, or 0 to format
+         * every message immediately (the default).
+         *
+         * @note Messages still waiting to be flushed are discarded.
+         */
+        void setDeferredCapacity(size_t capacity);
+
+        /**
+         * @brief Gathers each thread's deferred messages before publishing them.
+         *
+         * @param capacity The bytes each thread may gather, or 0 to publish every message
+         * on its own (the default).
+         *
+         * @note Gathered messages are published together when the next one would not fit,
+         * when an ERROR is logged, when flush sweeps every thread, or when the thread exits,
+         * which also frees its buffer. This saves an atomic publish per message at the cost
+         * of latency. Like setDeferredCapacity, call this before logging starts; messages
+         * already gathered are discarded. If publishing finds the buffer full, every
+         * gathered message counts towards getDroppedMessages.
+         */
+        void setThreadBatching(size_t capacity);
+
+        /**
+         * @brief Adds a sink with a queue of its own, alongside the print function.
+         *
+         * @param sink Function that writes a line, such as to a network collector.
+         * @param capacity The most bytes of lines the sink can fall behind by.
+         * @param policy Optional: What to do with new lines when the queue is full.
+         * @param ownThread Optional: Whether the sink is written from a thread of its own.
+         * Otherwise call deliverSink. Ignored when built with EMBEDLOG_NO_THREADS.
+         * @return The sink's index, for deliverSink and getSinkStats.
+         *
+         * @note Each sink has its own queue, so a slow sink only ever drops its own lines.
+         * Add sinks before logging starts.
+         */
+        size_t addSink(PrintFunction sink, size_t capacity, SinkPolicy policy = SinkPolicy::DROP_OLDEST, bool ownThread = true);
+
+        /**
+         * @brief Writes lines waiting for a sink without a thread of its own.
+         *
+         * @param sink The index returned by addSink.
+         * @param limit Optional: The most lines to write.
+         * @return The number of lines written.
+         */
+        size_t deliverSink(size_t sink, size_t limit = static_cast<size_t>(-1));
+
+        /**
+         * @brief Gets how far behind a sink is.
+         *
+         * @param sink The index returned by addSink.
+         * @return The sink's lag, queue size and counts of delivered and dropped lines.
+         */
+        SinkStats getSinkStats(size_t sink) const;
+
+        /**
+         * @brief Writes every line into memory that survives a warm reset, as well as printing it.
+         *
+         * @param region The memory, such as a noinit linker section, or a file mapped with
+         * mmap when testing on Linux. Pass nullptr to stop writing to it.
+         * @param size The size of the region in bytes.
+         *
+         * @note open prints the lines the previous boot left in the region, before starting
+         * afresh, so the last lines before a watchdog reset are not lost. If the log is
+         * already open this is done straight away. This happens once per region: reopening
+         * the log carries on appending. Lines are written to the region before they are
+         * printed. Each line costs a copy and a hash.
+         */
+        void setPersistentRegion(void* region, size_t size);
+
+        /**
+         * @brief Gets the number of lines recovered from the persistent region by open.
+         *
+         * @return The number of lines printed from the previous boot.
+         */
+        size_t getRecoveredLines() const;
+
+        /**
+         * @brief Writes every line to raw flash, as well as printing it.
+         *
+         * @param device The flash, which must outlive the log, or nullptr to stop writing to it.
+         * @return False if the device's geometry cannot hold a store.
+         *
+         * @note Lines are appended to a log-structured FlashStore rather than a file, and
+         * programmed a page at a time. close syncs the last part-filled page. Use
+         * getFlashStore to read the lines back.
+         */
+        bool setFlashStore(BlockDevice* device);
+
+        /**
+         * @brief Gets the flash store set by setFlashStore.
+         *
+         * @return The store, or nullptr if there is none.
+         */
+        FlashStore* getFlashStore();
+
+        /**
+         * @brief Keeps a compressed history of deferred messages in RAM.
+         *
+         * @param budget The bytes of RAM to use, or 0 to stop recording (the default).
+         * @param printLines Optional: Whether flush still prints messages. Otherwise they
+         * are only kept for dumpFlightRecorder.
+         *
+         * @note Flush moves each message into the recorder as it is drained, still as the
+         * captured arguments rather than text, compressing them in blocks. When the budget
+         * is used up the oldest blocks are discarded. Format strings and literals are kept
+         * as pointers, so they must outlive the recorder, as for deferred logging.
+         */
+        void setFlightRecorder(size_t budget, bool printLines = true);
+
+        /**
+         * @brief Formats and prints the history held by the flight recorder, oldest first.
+         *
+         * @param out Function that writes each line.
+         * @return The number of lines written.
+         *
+         * @note Flushes first, so the history ends with the newest message. Call it from
+         * the thread that flushes.
+         */
+        size_t dumpFlightRecorder(PrintFunction out);
+
+        /**
+         * @brief Gets how much history the flight recorder holds.
+         *
+         * @return The number of messages held and evicted, and the RAM they use.
+         */
+        FlightRecorderStats getFlightRecorderStats() const;
+
+        /**
+         * @brief Formats deferred messages on several threads during flush.
+         *
+         * @param threads The number of threads formatting, including the one calling flush,
+         * or 0 or 1 to format everything on the flushing thread (the default).
+         *
+         * @note Messages are still passed to the print function in the order they were
+         * captured, from the flushing thread. Has no effect when built with EMBEDLOG_NO_THREADS.
+         */
+        void setRenderThreads(size_t threads);
+
+        /**
+         * @brief Formats and prints every captured message, oldest first.
+         *
+         * @return The number of messages printed.
+         *
+         * @note Call this from a single thread or the idle loop. Messages can be captured
+         * from other threads and interrupts while it runs.
+         */
+        size_t flush();
+
+        /**
+         * @brief Gets the number of deferred messages dropped because the buffer was full.
+         *
+         * @return The number of dropped messages.
+         */
+        uint64_t getDroppedMessages() const;
+
+        /**
+         * @brief Starts a message to be built piece by piece.
+         *
+         * @param level The log level for the message.
+         * @param capacity Optional: The most bytes of text the message can hold when deferred.
+         * @return The builder. Write to it with << or reserve, then call commit.
+         *
+         * @note If the level is disabled the builder ignores everything written to it.
+         */
+        RecordBuilder begin(LogLevel level, size_t capacity = 256);
+
+        /**
+         * @brief Starts a batch of messages that share one timestamp and one enqueue.
+         *
+         * @param level The log level for every message in the batch.
+         * @param capacity Optional: The bytes reserved for the batch when deferred.
+         * @return The batch. Add messages with log, then call commit.
+         *
+         * @note The level is checked and the clock read once for the whole batch.
+         */
+        LogBatch batch(LogLevel level, size_t capacity = 4096);
+
+        /**
+         * @brief Starts a timer that logs the time taken by the current scope.
+         *
+         * @param level The log level for the message.
+         * @param name A name for the scope, such as "db query". It must outlive the timer.
+         * @param threshold Optional: The shortest time in microseconds that is logged.
+         * @return The timer, which logs "<name> took <n> us" when destroyed.
+         *
+         * @note If the level is disabled when the timer starts, the clock is not read at all.
+         */
+        ScopedTimer scopedTimer(LogLevel level, const char* name, uint64_t threshold = 0);
+
+        /**
+         * @brief Enables tracing, writing events as Chrome Trace Event JSON.
+         *
+         * @param traceFunc Function to write the trace to, typically a file, or an empty
+         * function to stop tracing.
+         *
+         * @note Trace events are captured with deferred messages when a deferred buffer
+         * is enabled and written by flush. The trace is finished when the log is closed.
+         */
+        void setTraceFunction(PrintFunction traceFunc);
+
+        /**
+         * @brief Checks whether trace events are being recorded.
+         */
+        bool isTracing() const
+        {
+            return isOpen && tracing;
+        }
+
+        /**
+         * @brief Records the start of a span.
+         *
+         * @param name The span's name. It must be a string literal or otherwise outlive the log.
+         */
+        void traceBegin(const char* name);
+
+        /**
+         * @brief Records the end of a span started by traceBegin on the same thread.
+         *
+         * @param name The span's name. It must be a string literal or otherwise outlive the log.
+         */
+        void traceEnd(const char* name);
+
+        /**
+         * @brief Records a single point in time.
+         *
+         * @param name The event's name. It must be a string literal or otherwise outlive the log.
+         */
+        void traceInstant(const char* name);
+
+        /**
+         * @brief Starts a span covering the current scope.
+         *
+         * @param name The span's name. It must be a string literal or otherwise outlive the log.
+         * @return The span, which records itself when destroyed.
+         */
+        TraceSpan traceSpan(const char* name);
+
+        /**
+         * @brief Ends the trace by writing its closing bracket.
+         *
+         * @note Called by close, after flushing deferred events. Events recorded afterwards
+         * start a new trace.
+         */
+        void finishTrace();
+
+        /**
+         * @brief Gets the configuration used by this log.
+         *
+         * @return The shared configuration, which can be passed to other logs.
+         */
+        const ConfigPointer& getConfig() const;
+
     private:
-        OpenFunction openFunc;                // Function for opening the log.
-        CloseFunction closeFunc;              // Function for closing the log.
-        PrintFunction printFunc;              // Function for printing log messages.
-        MicrosecondFunction microsecondFunc;  // Function for getting microsecond timestamps.
+        // Styles of Deferred Format
+        static constexpr uint16_t FORMAT_PRINTF = 0;  // Format is a printf style string.
+        static constexpr uint16_t FORMAT_BRACES = 1;  // Format is a BraceDescriptor.
+        static constexpr uint16_t FORMAT_TRACE = 2;   // Format is a trace event name.
+        static constexpr uint16_t FORMAT_TEXT = 3;    // Message is already text, written by a RecordBuilder.
+        static constexpr uint16_t FORMAT_BATCH = 4;   // Record holds several DeferredRecords, written by a LogBatch.
+        static constexpr uint16_t FORMAT_SAMPLED = 0x100; // Flag: the last captured argument is the sample rate.
 
-        ThrottleMap throttleMap;              // Map of throttle IDs to last message times.
-        LogLevel logLevel = INFO;             // Current log level.
-        bool isOpen = false;                  // Tracks whether the log is currently open.
-        std::string format;                   // Format for the timestamp.
-        std::string name;                     // Log name.
+        struct ThreadStage;
+        struct ThreadStageOwner;
+        struct FlushState;
+        struct Extensions;
+        struct Rendered;
+
+        // The fixed part of a deferred message, followed by its captured arguments
+        struct DeferredRecord
+        {
+            uint64_t timestamp;  // Time the message was logged.
+            const void* format;  // Format for the message.
+            uint32_t size;       // Bytes of captured arguments.
+            uint16_t level;      // Log level of the message, or phase of a trace event.
+            uint16_t style;      // Style of the format.
+        };
+
+        ConfigPointer config;                         // Shared immutable settings.
+        std::unique_ptr<RecordRing> records;          // Captured messages, if deferred logging is enabled.
+        std::atomic<ThrottleTable*> throttleTable{nullptr}; // Throttle IDs and last message times, created on first use.
+        uint64_t sampleThreshold = 1ull << 32;        // Sample rate scaled to a 32-bit random number.
+        double sampleRate = 1.0;                      // Sample rate, used to tag sampled messages.
+        LogLevel logLevel = INFO;                     // Current log level.
+        uint32_t throttleCapacity = 64;               // Maximum number of throttle IDs.
+        uint32_t stageCapacity = 0;                   // Bytes each thread gathers before publishing, or 0.
+        bool isOpen = false;                          // Tracks whether the log is currently open.
+        bool throttleCache = true;                    // Whether suppressed IDs are cached per thread.
+        bool coarseClock = false;                     // Whether messages use the cached time.
+        bool tracing = false;                         // Whether a trace function is set.
+        std::atomic<uint64_t> coarseTime{0};          // Time saved by updateClock.
+        std::unique_ptr<Extensions> extensions;       // Stages, sinks, tracing and storage, made on first use.
+
+        friend class TraceSpan;
+        friend class RecordBuilder;
+        friend class LogBatch;
+
+        /**
+         * @brief Records a trace event, capturing it if deferred logging is enabled.
+         *
+         * @param phase One of the TRACE_ phases.
+         * @param name The name of the event.
+         * @param timestamp The time of the event.
+         * @param duration The length of a TRACE_COMPLETE span.
+         */
+        void traceEvent(char phase, const char* name, uint64_t timestamp, uint64_t duration);
+
+        /**
+         * @brief Writes a trace event to the trace function.
+         */
+        void printTrace(char phase, const char* name, uint64_t timestamp, uint32_t thread, uint64_t duration);
+
+        /**
+         * @brief Writes a formatted trace event, separating it from the one before.
+         */
+        void writeTrace(const char* event, size_t length);
 
         /**
          * @brief Prints a message at a specified log level.
          *
          * @param level The log level of the message.
          * @param message The message to print.
+         * @param microseconds The time the message was logged.
+         * @param rate The sample rate the message passed, tagged onto the message if below 1.0.
          *
          * @note This function is called by the log function after a message 
          * has been formatted and the log level has been checked.
          */
-        void print(LogLevel level, const std::string& message);
+        void print(LogLevel level, const std::string& message, uint64_t microseconds, double rate = 1.0);
+
+        /**
+         * @brief Formats a deferred message into lines, ready to be printed.
+         *
+         * @param record The DeferredRecord, followed by its captured arguments.
+         * @param out The lines to append to.
+         *
+         * @note Only reads shared state, so several threads can format at once.
+         */
+        void renderDeferred(const uint8_t* record, Rendered& out) const;
+
+        /**
+         * @brief Gets the rarely used parts of the log, making them on first use.
+         *
+         * @note Only called while setting the log up; deferred logging makes them as it is enabled.
+         */
+        Extensions& getExtensions();
+
+        /**
+         * @brief Passes a printed line to the flash store and extra sinks.
+         *
+         * @note Only called once the extensions have been made.
+         */
+        void writeExtensions(uint64_t timestamp, const char* text, size_t length);
+
+        /**
+         * @brief Prints the lines left in the persistent region, then resets it for this boot.
+         *
+         * @note Only the first call after setPersistentRegion does anything.
+         */
+        void startPersistentRegion();
+
+        /**
+         * @brief Copies each message of a deferred record into the flight recorder.
+         *
+         * @param record The DeferredRecord, followed by its captured arguments.
+         * @param traces Where to format trace events, which are not recorded, or nullptr
+         * if they are formatted with the rest of the record.
+         */
+        void retainDeferred(const uint8_t* record, Rendered* traces);
+
+        /**
+         * @brief Passes formatted lines to the print and trace functions, in order.
+         *
+         * @param rendered The lines from renderDeferred.
+         */
+        void printRendered(Rendered& rendered);
+
+        /**
+         * @brief Captures a message into the deferred buffer.
+         *
+         * @param record The fixed part of the message. Its size is filled in here.
+         * @param args The values to capture.
+         */
+        template <typename... Args>
+        void capture(DeferredRecord record, const Args&... args)
+        {
+            record.size = static_cast<uint32_t>((size_t(0) + ... + capture_size(args)));
+            size_t total = sizeof(record) + record.size;
+
+            // Gather into this thread's stage when batching, falling back to the ring for a
+            // message too big for it, with the stage still held so nothing overtakes it
+            ThreadStage* stage = stageCapacity ? acquireStage(total) : nullptr;
+            bool staged = stage && total <= stageCapacity;
+            uint8_t* out = staged ? stageEnd(stage) : records->reserve(total);
+            if (!out)
+            {
+                if (stage)
+                    releaseStage(stage, 0, false);
+                EMBDL_PROBE1(drop, record.size);
+                return;
+            }
+
+            std::memcpy(out, &record, sizeof(record));
+            uint8_t* next = out + sizeof(record);
+            ((next = ::EmbedLog::capture(next, args)), ...);
+            if (staged)
+            {
+                releaseStage(stage, total, record.style != FORMAT_TRACE && record.level == ERROR);
+            }
+            else
+            {
+                records->commit(out);
+                if (stage)
+                    releaseStage(stage, 0, false);
+            }
+            EMBDL_PROBE2(enqueue, record.level, record.size);
+        }
+
+        /**
+         * @brief Locks the calling thread's stage, making room for a message.
+         *
+         * @param size The bytes the message needs. If they will not fit, the stage is
+         * published first.
+         * @return The locked stage, or nullptr if it is held by logging this call interrupted.
+         */
+        ThreadStage* acquireStage(size_t size);
+
+        /**
+         * @brief Gets the first free byte of a locked stage.
+         */
+        static uint8_t* stageEnd(ThreadStage* stage);
+
+        /**
+         * @brief Adds a message written at stageEnd to a stage and unlocks it.
+         *
+         * @param stage The stage from acquireStage.
+         * @param size The bytes the message used.
+         * @param publish Whether to publish the stage straight away.
+         */
+        void releaseStage(ThreadStage* stage, size_t size, bool publish);
+
+        /**
+         * @brief Publishes the calling thread's stage, before a message reserved straight
+         * in the ring, so it cannot overtake the messages the stage holds.
+         */
+        void publishThreadStage();
+
+        /**
+         * @brief Publishes a locked stage's messages to the ring as one record.
+         */
+        void publishStage(ThreadStage* stage);
+
+        /**
+         * @brief Publishes the stage of a thread that has exited and frees its buffer,
+         * leaving the stage for another thread to take over.
+         */
+        void retireStage(ThreadStage* stage);
+
+        /**
+         * @brief Records that the calling thread owns a stage, so it is retired when the
+         * thread exits.
+         */
+        void ownStage(ThreadStage* stage);
+
+        /**
+         * @brief Deletes every stage. Not safe while other threads are logging.
+         */
+        void clearStages();
+
+        /**
+         * @brief Formats a message and prints it.
+         *
+         * @param level The log level of the message.
+         * @param format The format string for the message.
+         * @param args The values to log.
+         * @param rate The sample rate the message passed, tagged onto the message if below 1.0.
+         *
+         * @note Callers are expected to have already checked the log level.
+         */
+        void vlog(LogLevel level, const std::string& format, va_list args, double rate = 1.0);
 
         /**
          * @brief Gets a string representation of the log level.
@@ -162,6 +1318,117 @@ namespace EmbedLog
          * @param level The log level to convert.
          * @return A string representation of the log level.
          */
-        std::string getLogLevelString(LogLevel level);
+        static const char* getLogLevelString(LogLevel level);
+    };
+
+    /**
+     * @class LogBatch
+     * @brief Logs many messages with one level check, one clock read and one enqueue.
+     *
+     * With a deferred buffer the batch reserves its space in the ring once, captures each
+     * message into it, and publishes them all with a single commit. Otherwise each message
+     * is printed straight away, still sharing the batch's timestamp. A batch that is
+     * destroyed without being committed is discarded.
+     */
+    class LogBatch
+    {
+    public:
+        /**
+         * @brief Starts a batch.
+         *
+         * @param log The log to write to, or nullptr to ignore every message.
+         * @param level The log level for every message.
+         * @param capacity The bytes to reserve when deferred.
+         */
+        LogBatch(EmbedLog* log, LogLevel level, size_t capacity);
+
+        LogBatch(LogBatch&& other) noexcept;
+        LogBatch(const LogBatch&) = delete;
+        LogBatch& operator=(const LogBatch&) = delete;
+        LogBatch& operator=(LogBatch&&) = delete;
+
+        /**
+         * @brief Discards the batch if it was not committed.
+         */
+        ~LogBatch();
+
+        /**
+         * @brief Adds a message using a printf style format.
+         *
+         * @param format The format string. It must be a string literal, as only its address is kept.
+         * @param args The values to log.
+         * @return True if the message was added, false if the batch is inactive or full.
+         */
+        template <typename... Args>
+        bool log(const char* format, const Args&... args)
+        {
+            if (!owner)
+                return false;
+
+            if (!record)
+            {
+                std::string message;
+                format_to(message, format, args...);
+                owner->print(level, message, timestamp);
+                return true;
+            }
+
+            return add(format, EmbedLog::FORMAT_PRINTF, args...);
+        }
+
+        /**
+         * @brief Adds a message using a brace format.
+         *
+         * @param format The format, made with EMBDL_FMT.
+         * @param args The values to log, checked against the format at compile time.
+         * @return True if the message was added, false if the batch is inactive or full.
+         */
+        template <typename Source, typename... Args>
+        bool log(BraceFormat<Source> format, const Args&... args)
+        {
+            static_assert(BraceFormat<Source>::template check<Args...>(), "EmbedLog: format string does not match its arguments");
+
+            if (!owner)
+                return false;
+
+            if (!record)
+            {
+                std::string message;
+                format_to(message, format, args...);
+                owner->print(level, message, timestamp);
+                return true;
+            }
+
+            return add(&BraceFormat<Source>::descriptor, EmbedLog::FORMAT_BRACES, args...);
+        }
+
+        /**
+         * @brief Publishes every message in the batch.
+         */
+        void commit();
+
+    private:
+        template <typename... Args>
+        bool add(const void* format, uint16_t style, const Args&... args)
+        {
+            EmbedLog::DeferredRecord header{timestamp, format, 0, static_cast<uint16_t>(level), style};
+            header.size = static_cast<uint32_t>((size_t(0) + ... + capture_size(args)));
+            if (sizeof(header) + header.size > capacity - size)
+                return false;
+
+            uint8_t* out = record + sizeof(header) + size;
+            std::memcpy(out, &header, sizeof(header));
+            out += sizeof(header);
+            ((out = capture(out, args)), ...);
+            size += sizeof(header) + header.size;
+            return true;
+        }
+
+        EmbedLog* owner;     // Log to write to, or nullptr when inactive.
+        uint8_t* record;     // Record reserved in the deferred buffer, or nullptr.
+        size_t size;         // Bytes of messages captured.
+        size_t capacity;     // Bytes the record can hold after its own header.
+        uint64_t timestamp;  // Time shared by every message.
+        LogLevel level;      // Log level of every message.
     };
 }
@@ -0,0 +1,95 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * FileBlockDevice simulates a BlockDevice in a file, for testing FlashStore
+ * on a host. It is only built with EMBEDLOG_FILE_BLOCK_DEVICE.
+ *
+ */
+
+#pragma once
+
+#include "EmbedLog/BlockDevice.hpp"
+
+#include <cstdio>
+#include <vector>
+
+namespace EmbedLog
+{
+    /**
+     * @class FileBlockDevice
+     * @brief A BlockDevice simulated in a file, for testing on a host.
+     *
+     * Programming clears bits but never sets them, as on NOR flash, and misaligned
+     * programs fail. Erases are counted per block to check wear.
+     */
+    class FileBlockDevice : public BlockDevice
+    {
+    public:
+        /**
+         * @brief Opens the file, creating it erased if it does not exist or is the wrong size.
+         *
+         * @param path The file to simulate the device in.
+         * @param blockSize The size of an erase block in bytes.
+         * @param blockCount The number of erase blocks.
+         * @param programSize Optional: The size of a program unit in bytes.
+         */
+        FileBlockDevice(const char* path, size_t blockSize, size_t blockCount, size_t programSize = 256);
+
+        FileBlockDevice(const FileBlockDevice&) = delete;
+        FileBlockDevice& operator=(const FileBlockDevice&) = delete;
+
+        ~FileBlockDevice() override;
+
+        /**
+         * @brief Checks the file was opened.
+         */
+        bool isOpen() const;
+
+        size_t getBlockSize() const override;
+        size_t getBlockCount() const override;
+        size_t getProgramSize() const override;
+        bool read(size_t block, size_t offset, void* data, size_t size) override;
+        bool program(size_t block, size_t offset, const void* data, size_t size) override;
+        bool erase(size_t block) override;
+
+        /**
+         * @brief Gets the number of times a block was erased since the device was opened.
+         */
+        uint32_t getEraseCount(size_t block) const;
+
+        /**
+         * @brief Gets the number of program units written since the device was opened.
+         */
+        uint64_t getProgramCount() const;
+
+    private:
+        // Checks a range lies within one block
+        bool inRange(size_t block, size_t offset, size_t size) const;
+
+        std::FILE* file = nullptr;        // The simulated flash.
+        size_t blockSize;                 // Size of an erase block.
+        size_t blockCount;                // Number of erase blocks.
+        size_t programSize;               // Size of a program unit.
+        std::vector<uint32_t> erases;     // Erases per block.
+        uint64_t programs = 0;            // Program units written.
+    };
+}
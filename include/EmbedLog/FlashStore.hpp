@@ -0,0 +1,198 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * FlashStore appends lines to raw flash as a log of erase block sized
+ * segments, without a filesystem, reusing blocks in turn so they wear
+ * evenly.
+ *
+ */
+
+
+#pragma once
+
+#include "EmbedLog/BlockDevice.hpp"
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if !defined(EMBEDLOG_NO_THREADS)
+#include <mutex>
+#endif
+
+namespace EmbedLog
+{
+    /**
+     * @struct FlashStoreStats
+     * @brief What a flash store holds and how worn the device is.
+     */
+    struct FlashStoreStats
+    {
+        size_t segments = 0;        // Blocks holding lines.
+        size_t activeBlock = 0;     // Block being appended to.
+        uint64_t lines = 0;         // Lines appended since mounting.
+        uint64_t pageWrites = 0;    // Program units written since mounting.
+        uint64_t failedWrites = 0;  // Program units the device failed to write since mounting.
+        uint64_t erases = 0;        // Blocks erased since mounting.
+        uint32_t minEraseCount = 0; // Fewest times any block has been erased.
+        uint32_t maxEraseCount = 0; // Most times any block has been erased.
+    };
+
+    /**
+     * @class FlashStore
+     * @brief A log-structured store of lines on a BlockDevice.
+     *
+     * Each erase block is a segment starting with a header holding its sequence number
+     * and erase count. Lines are packed into a page buffer and programmed a whole page at
+     * a time, and each carries a hash so a page torn by a reset is skipped. When the active
+     * segment fills, the next block in turn is erased, discarding the oldest lines, so
+     * every block is erased equally often. Mounting reads only the segment headers and
+     * a few pages of the active segment to find where to carry on.
+     */
+    class FlashStore
+    {
+    public:
+        using LineFunction = std::function<void(const std::string&)>;
+
+        /**
+         * @brief Constructs a new FlashStore. Call mount before appending.
+         *
+         * @param device The flash. It must outlive the FlashStore.
+         */
+        explicit FlashStore(BlockDevice& device);
+
+        FlashStore(const FlashStore&) = delete;
+        FlashStore& operator=(const FlashStore&) = delete;
+
+        /**
+         * @brief Writes any buffered lines.
+         */
+        ~FlashStore();
+
+        /**
+         * @brief Finds the segments on the device and where to carry on appending.
+         *
+         * @return False if the device's geometry cannot hold a store.
+         */
+        bool mount();
+
+        /**
+         * @brief Adds a line, programming the page buffer whenever it fills.
+         *
+         * @param text The line.
+         * @param length The length of the line. Lines too long for a segment are cut short.
+         * @return False if the device failed, including while programming the lines before
+         *         this one as their segment was closed.
+         */
+        bool append(const char* text, size_t length);
+
+        /**
+         * @brief Programs a part-filled page buffer, so lines survive a reset.
+         *
+         * @return False if the device failed.
+         *
+         * @note The rest of the page is left unused, so sync sparingly.
+         */
+        bool sync();
+
+        /**
+         * @brief Passes every line on the device to a function, oldest first.
+         *
+         * @param consume Function taking each line.
+         * @return The number of lines read.
+         *
+         * @note Lines still in the page buffer are not included; call sync first.
+         */
+        size_t read(const LineFunction& consume);
+
+        /**
+         * @brief Erases every segment.
+         *
+         * @return False if the device failed.
+         */
+        bool format();
+
+        /**
+         * @brief Gets what the store holds and how worn the device is.
+         */
+        FlashStoreStats getStats() const;
+
+    private:
+        struct SegmentHeader
+        {
+            uint32_t magic;       // Marks the block as a segment.
+            uint32_t sequence;    // Order the segment was started in.
+            uint32_t eraseCount;  // Times the block has been erased.
+            uint32_t check;       // Hash of the fields above.
+        };
+
+        struct Segment
+        {
+            uint32_t sequence = 0;    // Order the segment was started in.
+            uint32_t eraseCount = 0;  // Times the block has been erased, as far as is known.
+            bool valid = false;       // Whether the block holds a segment.
+        };
+
+        // Erases the next block in turn and starts a segment in it
+        bool openSegment();
+
+        // Programs the page buffer, padding it with 0xFF
+        bool programPage();
+
+        // Finds the first erased page of the active segment
+        size_t findEnd();
+
+        // Copies bytes into the page buffer, programming it as it fills
+        bool write(const void* data, size_t size);
+
+        // Reads the lines of one segment
+        size_t readSegment(size_t block, uint32_t sequence, const LineFunction& consume, std::string& line);
+
+        // Gets the check for a line at a position in a segment
+        static uint16_t lineCheck(const char* text, size_t length, uint32_t sequence, size_t offset);
+
+        static uint32_t headerCheck(const SegmentHeader& header);
+
+        BlockDevice& device;                 // The flash.
+        size_t blockSize = 0;                // Size of a segment.
+        size_t pageSize = 0;                 // Size of a program unit.
+        std::vector<Segment> segments;       // What each block holds.
+        std::unique_ptr<uint8_t[]> page;     // Bytes waiting to be programmed.
+        size_t buffered = 0;                 // Bytes in page.
+        size_t active = 0;                   // Block being appended to.
+        size_t offset = 0;                   // Where page will be programmed in the active block.
+        uint32_t sequence = 0;               // Sequence of the active segment.
+        bool mounted = false;                // Whether mount succeeded.
+        bool hasActive = false;              // Whether a segment has been started.
+        uint64_t lines = 0;                  // Lines appended since mounting.
+        uint64_t pageWrites = 0;             // Pages programmed since mounting.
+        uint64_t failedWrites = 0;           // Pages the device failed to program since mounting.
+        uint64_t erases = 0;                 // Blocks erased since mounting.
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        mutable std::mutex mutex;            // Guards appends from several threads.
+#endif
+    };
+}
@@ -0,0 +1,151 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * FlightRecorder keeps a history of deferred messages in RAM, compressing
+ * older ones in blocks so a small budget covers a long stretch of time.
+ * Messages are only decompressed and formatted when the history is dumped.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+
+namespace EmbedLog
+{
+    /**
+     * @struct FlightRecorderStats
+     * @brief How much history a flight recorder holds.
+     */
+    struct FlightRecorderStats
+    {
+        uint64_t records = 0;     // Messages held.
+        uint64_t evicted = 0;     // Messages discarded to make room for newer ones.
+        uint64_t dropped = 0;     // Messages too big for a block.
+        size_t blocks = 0;        // Compressed blocks held.
+        size_t storedBytes = 0;   // Bytes used, including the block being filled.
+        size_t rawBytes = 0;      // Bytes the held messages take uncompressed.
+        uint64_t span = 0;        // Microseconds between the oldest and newest message held.
+    };
+
+    /**
+     * @class FlightRecorder
+     * @brief A fixed budget of RAM holding the most recent records, oldest compressed.
+     *
+     * Records are gathered into an open block. When it fills, the block is compressed into
+     * a ring of blocks, evicting the oldest blocks to make room. Nothing is decompressed
+     * until replay. A record's first 8 bytes are taken to be a timestamp and stored as the
+     * difference from the record before, which compresses far better.
+     */
+    class FlightRecorder
+    {
+    public:
+        using RecordFunction = std::function<void(const uint8_t* record, size_t size)>;
+
+        /**
+         * @brief Constructs a new FlightRecorder.
+         *
+         * @param budget The bytes of RAM to use, including the open block and compression scratch.
+         * @param blockSize Optional: The bytes of records compressed together, up to
+         * COMPRESS_MAX_BLOCK. Larger blocks compress better but lose more history at a time
+         * when evicted.
+         */
+        explicit FlightRecorder(size_t budget, size_t blockSize = 4096);
+
+        FlightRecorder(const FlightRecorder&) = delete;
+        FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+        /**
+         * @brief Adds a record, compressing the open block if it is full.
+         *
+         * @param timestamp The time of the record.
+         * @param record The record's bytes.
+         * @param size The size of the record.
+         * @return False if the record is too big for a block.
+         */
+        bool append(uint64_t timestamp, const uint8_t* record, size_t size);
+
+        /**
+         * @brief Passes every record held to a function, oldest first.
+         *
+         * @param consume Function taking each record and its size. Records are 8 byte aligned.
+         * @return The number of records passed.
+         */
+        size_t replay(const RecordFunction& consume) const;
+
+        /**
+         * @brief Discards every record held.
+         */
+        void clear();
+
+        /**
+         * @brief Gets how much history is held.
+         */
+        FlightRecorderStats getStats() const;
+
+    private:
+        struct Block
+        {
+            uint64_t first;     // Time of the first record.
+            uint64_t last;      // Time of the last record.
+            uint32_t stored;    // Bytes stored after the header, or PADDING.
+            uint32_t raw;       // Bytes of records before compression.
+            uint32_t records;   // Number of records.
+            uint32_t flags;     // BLOCK_COMPRESSED if the bytes are compressed.
+        };
+
+        static constexpr uint32_t PADDING = 0xFFFFFFFF;
+        static constexpr uint32_t BLOCK_COMPRESSED = 1;
+
+        // Compresses the open block into the ring
+        void seal();
+
+        // Finds the oldest block, past any padding
+        const Block* oldest() const;
+
+        // Removes the oldest block
+        void popOldest();
+
+        // Passes the records in a block of raw bytes to consume
+        static size_t replayBlock(const uint8_t* data, size_t size, const RecordFunction& consume);
+
+        std::unique_ptr<uint8_t[]> ring;     // Compressed blocks, each after its Block header.
+        size_t capacity;                     // Size of ring in bytes.
+        uint64_t head = 0;                   // Total bytes written to ring.
+        uint64_t tail = 0;                   // Total bytes removed from ring.
+        std::unique_ptr<uint8_t[]> open;     // Records not yet compressed.
+        std::unique_ptr<uint8_t[]> scratch;  // Where blocks are compressed.
+        std::unique_ptr<uint16_t[]> table;   // Hash table for compressing.
+        size_t blockSize;                    // Size of open and scratch.
+        Block current{};                     // Header for the open block.
+        uint64_t newest = 0;                 // Time of the newest record.
+        size_t blocks = 0;                   // Blocks in ring.
+        uint64_t records = 0;                // Records in ring.
+        size_t rawBytes = 0;                 // Uncompressed bytes of records in ring.
+        uint64_t evicted = 0;                // Records evicted from ring.
+        uint64_t dropped = 0;                // Records too big to hold.
+    };
+}
@@ -0,0 +1,232 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Formatter is the customisation point for logging user types. A Formatter
+ * appends a value straight to the message being built when logging
+ * immediately, and an optional encode and decode pair stores a compact
+ * binary form when logging is deferred.
+ *
+ */
+
+
+#pragma once
+
+#include "EmbedLog/Capture.hpp"
+
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace EmbedLog
+{
+    /**
+     * @struct Formatter
+     * @brief Formats a value of a user type.
+     *
+     * Specialise Formatter with a format function that appends the value to the message.
+     * Types that are trivially copyable are captured for deferred logging by copying their
+     * bytes. Other types also provide size and encode functions to capture a compact form,
+     * and a decode function that formats the captured form. Values with a Formatter match
+     * the %s conversion.
+     *
+     * @code
+     * template <>
+     * struct EmbedLog::Formatter<IPv4Address>
+     * {
+     *     static void format(std::string& out, const IPv4Address& address);
+     * };
+     *
+     * template <>
+     * struct EmbedLog::Formatter<std::vector<float>>
+     * {
+     *     static void format(std::string& out, const std::vector<float>& values);
+     *     static size_t size(const std::vector<float>& values);
+     *     static void encode(uint8_t* out, const std::vector<float>& values);
+     *     static void decode(std::string& out, const uint8_t* data, size_t size);
+     * };
+     * @endcode
+     */
+    template <typename T, typename Enable = void>
+    struct Formatter {};
+
+    template <typename T, typename = void>
+    struct has_formatter : std::false_type {};
+
+    template <typename T>
+    struct has_formatter<T, std::void_t<decltype(Formatter<T>::format(std::declval<std::string&>(), std::declval<const T&>()))>>
+        : std::true_type {};
+
+    template <typename T, typename = void>
+    struct has_formatter_codec : std::false_type {};
+
+    template <typename T>
+    struct has_formatter_codec<T, std::void_t<decltype(Formatter<T>::size(std::declval<const T&>())),
+                                              decltype(Formatter<T>::encode(std::declval<uint8_t*>(), std::declval<const T&>())),
+                                              decltype(Formatter<T>::decode(std::declval<std::string&>(), std::declval<const uint8_t*>(), size_t()))>>
+        : std::true_type {};
+
+    // Captures types with a Formatter for deferred logging
+    template <typename T>
+    struct Serializer<T, std::enable_if_t<std::is_class<T>::value && has_formatter<T>::value>>
+    {
+        static_assert(has_formatter_codec<T>::value || std::is_trivially_copyable<T>::value,
+                      "EmbedLog: Formatter needs size, encode and decode for types that are not trivially copyable");
+
+        static constexpr ArgType type = ArgType::CUSTOM;
+
+        static size_t size(const T& value)
+        {
+            if constexpr (has_formatter_codec<T>::value)
+                return Formatter<T>::size(value);
+            else
+                return sizeof(T);
+        }
+
+        static void encode(uint8_t* out, const T& value)
+        {
+            if constexpr (has_formatter_codec<T>::value)
+                Formatter<T>::encode(out, value);
+            else
+                std::memcpy(out, &value, sizeof(T));
+        }
+
+        static void render(std::string& out, const uint8_t* data, size_t size)
+        {
+            if constexpr (has_formatter_codec<T>::value)
+                Formatter<T>::decode(out, data, size);
+            else
+            {
+                alignas(T) unsigned char storage[sizeof(T)];
+                std::memcpy(storage, data, sizeof(T));
+                Formatter<T>::format(out, *reinterpret_cast<const T*>(storage));
+            }
+        }
+    };
+
+    namespace detail
+    {
+        inline std::string_view string_view_of(const char* text)
+        {
+            return text ? std::string_view(text) : std::string_view("(null)");
+        }
+
+        inline std::string_view string_view_of(std::string_view text)
+        {
+            return text;
+        }
+
+        template <typename T>
+        void render_live(std::string& out, const uint8_t* data, size_t)
+        {
+            Formatter<T>::format(out, *reinterpret_cast<const T*>(data));
+        }
+
+        template <typename T>
+        constexpr bool is_viewable()
+        {
+            using D = std::decay_t<T>;
+            return Serializer<D>::type != ArgType::CUSTOM || has_formatter<D>::value;
+        }
+    }
+
+    /**
+     * @brief Makes an ArgValue that refers to a live argument.
+     *
+     * @param value The argument, which must outlive the ArgValue.
+     * @return The ArgValue.
+     */
+    template <typename T>
+    ArgValue make_arg(const T& value)
+    {
+        using D = std::decay_t<T>;
+        constexpr ArgType type = Serializer<D>::type;
+
+        ArgValue arg;
+        arg.type = type;
+        if constexpr (type == ArgType::INT32 || type == ArgType::INT64)
+            arg.value.i = static_cast<int64_t>(value);
+        else if constexpr (type == ArgType::UINT32 || type == ArgType::UINT64)
+            arg.value.u = static_cast<uint64_t>(value);
+        else if constexpr (type == ArgType::DOUBLE)
+            arg.value.d = static_cast<double>(value);
+        else if constexpr (type == ArgType::POINTER)
+            arg.value.p = static_cast<const void*>(value);
+        else if constexpr (type == ArgType::STATIC_STRING)
+        {
+            arg.text = value.text;
+            arg.size = std::strlen(value.text);
+        }
+        else if constexpr (type == ArgType::STRING)
+        {
+            std::string_view text = detail::string_view_of(value);
+            arg.text = text.data();
+            arg.size = text.size();
+        }
+        else
+        {
+            arg.text = reinterpret_cast<const char*>(&value);
+            arg.render = &detail::render_live<D>;
+        }
+        return arg;
+    }
+
+    namespace detail
+    {
+        // Calls render(const ArgValue* values, size_t count) with the arguments
+        template <typename Render, typename... Args>
+        void with_arg_values(Render&& render, const Args&... args)
+        {
+            if constexpr ((is_viewable<Args>() && ...))
+            {
+                ArgValue values[sizeof...(Args) + 1] = {make_arg(args)...};
+                render(values, sizeof...(Args));
+            }
+            else
+            {
+                // Types with only a Serializer have to be captured before they can be formatted
+                std::vector<uint8_t> buffer((size_t(0) + ... + capture_size(args)));
+                uint8_t* next = buffer.data();
+                ((next = capture(next, args)), ...);
+
+                ArgValue values[MAX_ARGS];
+                render(values, decode_args(buffer.data(), buffer.size(), values, MAX_ARGS));
+            }
+        }
+    }
+
+    /**
+     * @brief Formats arguments using a printf style format string.
+     *
+     * @param out The string to append the message to.
+     * @param format The format string.
+     * @param args The arguments. Types with a Formatter are written straight to out.
+     */
+    template <typename... Args>
+    void format_to(std::string& out, const char* format, const Args&... args)
+    {
+        detail::with_arg_values([&out, format](const ArgValue* values, size_t count) {
+            render_format(out, format, values, count);
+        }, args...);
+    }
+} // namespace EmbedLog
@@ -0,0 +1,174 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Hash provides the small, fast hash functions EmbedLog uses for throttle
+ * IDs, including a constexpr string hash for call site IDs and content
+ * hashes built from a format string and selected arguments without rendering
+ * the message.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
+namespace EmbedLog
+{
+    constexpr uint64_t HASH_SEED = 0x243F6A8885A308D3ull;
+
+    /**
+     * @brief Mixes a value into a hash.
+     *
+     * @param hash The hash so far.
+     * @param value The value to mix in.
+     * @return The new hash.
+     */
+    constexpr uint64_t hash_mix(uint64_t hash, uint64_t value)
+    {
+        uint64_t x = (hash ^ value) * 0x9E3779B97F4A7C15ull;
+        x ^= x >> 29;
+        x *= 0xBF58476D1CE4E5B9ull;
+        x ^= x >> 32;
+        return x;
+    }
+
+    /**
+     * @brief Hashes a null terminated string one byte at a time.
+     *
+     * @param text The string to hash.
+     * @param seed The hash to continue from.
+     * @return The hash of the string.
+     *
+     * @note This is constexpr so call site IDs can be computed by the compiler. Use
+     * hash_bytes for strings only known at run-time.
+     */
+    constexpr uint64_t hash_string(const char* text, uint64_t seed = HASH_SEED)
+    {
+        uint64_t hash = seed;
+        while (*text)
+            hash = (hash ^ static_cast<unsigned char>(*text++)) * 0x100000001B3ull;
+        return hash_mix(hash, seed);
+    }
+
+    /**
+     * @brief Hashes a block of memory a word at a time.
+     *
+     * @param data The memory to hash.
+     * @param size The number of bytes to hash.
+     * @param seed The hash to continue from.
+     * @return The hash of the memory.
+     */
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = HASH_SEED);
+
+    /**
+     * @struct Hasher
+     * @brief Hashes a value of type T for content based throttling.
+     *
+     * Integers, enums, floating point numbers, pointers, strings and tuples are
+     * supported. Specialise Hasher for other types to use them as throttle keys.
+     */
+    template <typename T, typename Enable = void>
+    struct Hasher;
+
+    template <typename T>
+    struct Hasher<T, std::enable_if_t<std::is_integral<T>::value || std::is_enum<T>::value>>
+    {
+        static uint64_t hash(uint64_t seed, T value) { return hash_mix(seed, static_cast<uint64_t>(value)); }
+    };
+
+    template <typename T>
+    struct Hasher<T, std::enable_if_t<std::is_floating_point<T>::value>>
+    {
+        static uint64_t hash(uint64_t seed, T value)
+        {
+            double wide = value;
+            uint64_t bits = 0;
+            std::memcpy(&bits, &wide, sizeof(bits));
+            return hash_mix(seed, bits);
+        }
+    };
+
+    template <typename T>
+    struct Hasher<T*>
+    {
+        static uint64_t hash(uint64_t seed, const T* value) { return hash_mix(seed, reinterpret_cast<uintptr_t>(value)); }
+    };
+
+    template <>
+    struct Hasher<const char*>
+    {
+        static uint64_t hash(uint64_t seed, const char* value)
+        {
+            return value ? hash_bytes(value, std::strlen(value), seed) : hash_mix(seed, 0);
+        }
+    };
+
+    template <>
+    struct Hasher<char*> : Hasher<const char*> {};
+
+    template <>
+    struct Hasher<std::string_view>
+    {
+        static uint64_t hash(uint64_t seed, std::string_view value) { return hash_bytes(value.data(), value.size(), seed); }
+    };
+
+    template <>
+    struct Hasher<std::string> : Hasher<std::string_view> {};
+
+    template <typename... Ts>
+    struct Hasher<std::tuple<Ts...>>
+    {
+        static uint64_t hash(uint64_t seed, const std::tuple<Ts...>& value)
+        {
+            return std::apply([seed](const auto&... items) {
+                uint64_t result = seed;
+                ((result = Hasher<std::decay_t<decltype(items)>>::hash(result, items)), ...);
+                return result;
+            }, value);
+        }
+    };
+
+    /**
+     * @brief Builds a throttle ID from a format string and selected arguments.
+     *
+     * @param format The format string. Only its address is hashed, not its contents.
+     * @param args The arguments that distinguish one message from another.
+     * @return A throttle ID for log_throttled.
+     *
+     * @note Nothing is rendered. Identical string literals are normally merged by the
+     * compiler, so the same message from different call sites shares an ID.
+     */
+    template <typename... Args>
+    uint64_t content_id(const char* format, const Args&... args)
+    {
+        uint64_t hash = hash_mix(HASH_SEED, reinterpret_cast<uintptr_t>(format));
+        ((hash = Hasher<std::decay_t<Args>>::hash(hash, args)), ...);
+        return hash;
+    }
+} // namespace EmbedLog
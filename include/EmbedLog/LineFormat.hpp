@@ -0,0 +1,452 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * LineFormat turns the line format, such as "[%D:%H:%M:%S.%U %N %L] %T",
+ * into a renderer. Formats known at compile time become a straight-line
+ * renderer; others are compiled into a token list once when the log is
+ * created.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Compile-Time Line Formats
+// EMBDL_LINE_FORMAT("[%H:%M:%S %L] %T") makes a LineFormat whose renderer is generated
+// by the compiler for that exact format.
+#define EMBDL_LINE_FORMAT(text)                                                        \
+    ([]() {                                                                            \
+        struct EmbdlLineSource                                                         \
+        {                                                                              \
+            static constexpr const char* value() { return text; }                      \
+        };                                                                             \
+        return ::EmbedLog::static_line_format<EmbdlLineSource>();                      \
+    }())
+
+namespace EmbedLog
+{
+    /**
+     * @enum LineField
+     * @brief The parts of a log line.
+     */
+    enum class LineField : uint8_t
+    {
+        TEXT,         // Literal text from the format.
+        NAME,         // %N, the log name.
+        LEVEL,        // %L, the log level.
+        MESSAGE,      // %T, the message.
+        DAYS,         // %D, days since start, at least two digits.
+        HOURS,        // %H, hours of the day.
+        MINUTES,      // %M, minutes of the hour.
+        SECONDS,      // %S, seconds of the minute.
+        MICROSECONDS  // %U, microseconds of the second.
+    };
+
+    /**
+     * @struct LineToken
+     * @brief One field of a line format, with its text when it is literal.
+     */
+    struct LineToken
+    {
+        LineField field = LineField::TEXT;  // What to print.
+        uint16_t offset = 0;                // Start of the literal text in the format.
+        uint16_t length = 0;                // Length of the literal text.
+    };
+
+    /**
+     * @struct LineClock
+     * @brief A timestamp split into the fields of a line.
+     *
+     * Consecutive lines are usually stamped within a second or so of each other, so update
+     * carries on from the previous timestamp rather than dividing the whole value again.
+     */
+    struct LineClock
+    {
+        uint64_t days = 0;
+        uint32_t hours = 0;
+        uint32_t minutes = 0;
+        uint32_t seconds = 0;
+        uint32_t micros = 0;
+        uint64_t second = ~0ull;  // Whole seconds of the last timestamp.
+
+        /**
+         * @brief Splits a timestamp, starting from the previous one where possible.
+         *
+         * @param microseconds The timestamp.
+         */
+        void update(uint64_t microseconds)
+        {
+            uint64_t next = microseconds / 1000000;
+            micros = static_cast<uint32_t>(microseconds - next * 1000000);
+            if (next == second)
+                return;
+
+            if (next > second && next - second < 60)
+            {
+                // Carry into the minutes, hours and days only when the seconds wrap
+                seconds += static_cast<uint32_t>(next - second);
+                if (seconds >= 60)
+                {
+                    seconds -= 60;
+                    if (++minutes == 60)
+                    {
+                        minutes = 0;
+                        if (++hours == 24)
+                        {
+                            hours = 0;
+                            ++days;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                seconds = static_cast<uint32_t>(next % 60);
+                minutes = static_cast<uint32_t>(next / 60 % 60);
+                hours = static_cast<uint32_t>(next / 3600 % 24);
+                days = next / 86400;
+            }
+            second = next;
+        }
+    };
+
+    /**
+     * @struct LineFields
+     * @brief The values used to render one log line.
+     */
+    struct LineFields
+    {
+        const std::string& name;     // Log name.
+        const char* level;           // Log level name.
+        const std::string& message;  // Formatted message.
+        uint64_t microseconds;       // Timestamp of the message.
+        LineClock* clock = nullptr;  // Optional: The clock of the previous line, to carry on from.
+    };
+
+    class LineFormat;
+
+    using LineRenderer = void (*)(std::string& out, const LineFields& fields, const LineFormat& format);
+
+    /**
+     * @class LineFormat
+     * @brief A line format prepared for rendering.
+     */
+    class LineFormat
+    {
+    public:
+        LineFormat() = default;
+
+        /**
+         * @brief Compiles a line format at run-time.
+         *
+         * @param format The format. %D, %H, %M, %S, %U, %N, %L and %T are replaced
+         * by their fields, and anything else is printed as is.
+         */
+        explicit LineFormat(std::string format);
+
+        /**
+         * @brief Wraps a renderer generated for a format known at compile time.
+         *
+         * @param format The format text.
+         * @param renderer The generated renderer.
+         */
+        LineFormat(const char* format, LineRenderer renderer);
+
+        /**
+         * @brief Appends a rendered line, including its newline, to out.
+         *
+         * @param out The string to append to.
+         * @param fields The values for the line.
+         */
+        void render(std::string& out, const LineFields& fields) const
+        {
+            renderer(out, fields, *this);
+        }
+
+        /**
+         * @brief Returns true when the format has been compiled.
+         */
+        bool isValid() const { return renderer != nullptr; }
+
+        /**
+         * @brief Returns the format text.
+         */
+        const std::string& getFormat() const { return format; }
+
+        /**
+         * @brief Returns the tokens of a format compiled at run-time.
+         */
+        const std::vector<LineToken>& getTokens() const { return tokens; }
+
+    private:
+        std::string format;              // Format text.
+        std::vector<LineToken> tokens;   // Tokens of a run-time format.
+        LineRenderer renderer = nullptr; // Renders a line.
+    };
+
+    namespace detail
+    {
+        // Two digit strings for 00 to 99
+        inline constexpr char DIGIT_PAIRS[] =
+            "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+            "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+            "8081828384858687888990919293949596979899";
+
+        // Largest number of characters a field can add besides the variable length ones
+        constexpr size_t MAX_DAYS_DIGITS = 20;
+
+        inline char* write_pair(char* out, uint32_t value)
+        {
+            out[0] = DIGIT_PAIRS[value * 2];
+            out[1] = DIGIT_PAIRS[value * 2 + 1];
+            return out + 2;
+        }
+
+        // Converts a number below 10^8 to eight ASCII digits at once, in memory order
+        inline uint64_t eight_digits(uint32_t value)
+        {
+            uint64_t merged = (value / 10000) | (static_cast<uint64_t>(value % 10000) << 32);
+            uint64_t hundreds = ((merged * 10486) >> 20) & 0x0000007F0000007Full;
+            uint64_t pairs = ((merged - hundreds * 100) << 16) | hundreds;
+            uint64_t tens = ((pairs * 103) >> 10) & 0x000F000F000F000Full;
+            uint64_t digits = ((pairs - tens * 10) << 8) | tens;
+            return digits + 0x3030303030303030ull;
+        }
+
+        inline char* write_micros(char* out, uint32_t value)
+        {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+            out = write_pair(out, value / 10000);
+            out = write_pair(out, value / 100 % 100);
+            return write_pair(out, value % 100);
+#else
+            // Six digits are the last six of eight
+            char digits[8];
+            uint64_t packed = eight_digits(value);
+            std::memcpy(digits, &packed, sizeof(packed));
+            std::memcpy(out, digits + 2, 6);
+            return out + 6;
+#endif
+        }
+
+        inline char* write_days(char* out, uint64_t value)
+        {
+            if (value < 100)
+                return write_pair(out, static_cast<uint32_t>(value));
+
+            char text[MAX_DAYS_DIGITS];
+            char* end = text + sizeof(text);
+            char* start = end;
+            while (value)
+            {
+                *--start = static_cast<char>('0' + value % 10);
+                value /= 10;
+            }
+            while (start != end)
+                *out++ = *start++;
+            return out;
+        }
+
+        inline char* write_text(char* out, const char* text, size_t length)
+        {
+            std::memcpy(out, text, length);
+            return out + length;
+        }
+
+        constexpr LineField line_field(char c)
+        {
+            switch (c)
+            {
+            case 'N': return LineField::NAME;
+            case 'L': return LineField::LEVEL;
+            case 'T': return LineField::MESSAGE;
+            case 'D': return LineField::DAYS;
+            case 'H': return LineField::HOURS;
+            case 'M': return LineField::MINUTES;
+            case 'S': return LineField::SECONDS;
+            case 'U': return LineField::MICROSECONDS;
+            default: return LineField::TEXT;
+            }
+        }
+
+        constexpr size_t line_length(const char* text)
+        {
+            size_t length = 0;
+            while (text[length])
+                ++length;
+            return length;
+        }
+
+        // Counts the tokens in a format; literal text between fields is one token
+        constexpr size_t count_line_tokens(const char* text)
+        {
+            size_t count = 0;
+            bool inText = false;
+            for (size_t i = 0; text[i]; ++i)
+            {
+                if (text[i] == '%' && line_field(text[i + 1]) != LineField::TEXT)
+                {
+                    ++count;
+                    ++i;
+                    inText = false;
+                }
+                else if (!inText)
+                {
+                    ++count;
+                    inText = true;
+                }
+            }
+            return count;
+        }
+
+        template <size_t N>
+        struct LineTokens
+        {
+            LineToken tokens[N > 0 ? N : 1] = {};
+        };
+
+        template <size_t N>
+        constexpr LineTokens<N> parse_line_format(const char* text)
+        {
+            LineTokens<N> parsed{};
+            size_t count = 0;
+            for (size_t i = 0; text[i]; ++i)
+            {
+                LineField field = text[i] == '%' ? line_field(text[i + 1]) : LineField::TEXT;
+                if (field != LineField::TEXT)
+                {
+                    parsed.tokens[count++].field = field;
+                    ++i;
+                }
+                else if (count > 0 && parsed.tokens[count - 1].field == LineField::TEXT &&
+                         parsed.tokens[count - 1].offset + parsed.tokens[count - 1].length == i)
+                {
+                    ++parsed.tokens[count - 1].length;
+                }
+                else
+                {
+                    parsed.tokens[count].offset = static_cast<uint16_t>(i);
+                    parsed.tokens[count].length = 1;
+                    ++count;
+                }
+            }
+            return parsed;
+        }
+
+        // Space needed by the fixed part of a line, without the name, level and message
+        template <size_t N>
+        constexpr size_t line_reserve(const LineTokens<N>& parsed)
+        {
+            size_t size = 1; // Newline
+            for (size_t i = 0; i < N; ++i)
+            {
+                switch (parsed.tokens[i].field)
+                {
+                case LineField::TEXT: size += parsed.tokens[i].length; break;
+                case LineField::DAYS: size += MAX_DAYS_DIGITS; break;
+                case LineField::MICROSECONDS: size += 6; break;
+                case LineField::HOURS:
+                case LineField::MINUTES:
+                case LineField::SECONDS: size += 2; break;
+                default: break;
+                }
+            }
+            return size;
+        }
+
+        template <typename Source>
+        struct StaticLineFormat
+        {
+            static constexpr const char* text = Source::value();
+            static constexpr size_t count = count_line_tokens(text);
+            static constexpr LineTokens<count> parsed = parse_line_format<count>(text);
+            static constexpr size_t reserve = line_reserve(parsed);
+
+            template <size_t I>
+            static char* write(char* out, const LineFields& fields, const LineClock& time, size_t levelLength)
+            {
+                constexpr LineToken token = parsed.tokens[I];
+                if constexpr (token.field == LineField::TEXT)
+                    return write_text(out, text + token.offset, token.length);
+                else if constexpr (token.field == LineField::NAME)
+                    return write_text(out, fields.name.data(), fields.name.size());
+                else if constexpr (token.field == LineField::LEVEL)
+                    return write_text(out, fields.level, levelLength);
+                else if constexpr (token.field == LineField::MESSAGE)
+                    return write_text(out, fields.message.data(), fields.message.size());
+                else if constexpr (token.field == LineField::DAYS)
+                    return write_days(out, time.days);
+                else if constexpr (token.field == LineField::HOURS)
+                    return write_pair(out, time.hours);
+                else if constexpr (token.field == LineField::MINUTES)
+                    return write_pair(out, time.minutes);
+                else if constexpr (token.field == LineField::SECONDS)
+                    return write_pair(out, time.seconds);
+                else
+                    return write_micros(out, time.micros);
+            }
+
+            template <size_t... I>
+            static void render(std::string& out, const LineFields& fields, std::index_sequence<I...>)
+            {
+                LineClock local;
+                LineClock& time = fields.clock ? *fields.clock : local;
+                time.update(fields.microseconds);
+                size_t levelLength = line_length(fields.level);
+
+                size_t start = out.size();
+                out.resize(start + reserve + fields.name.size() + levelLength + fields.message.size());
+
+                char* next = &out[start];
+                ((next = write<I>(next, fields, time, levelLength)), ...);
+                *next++ = '\n';
+                out.resize(next - out.data());
+            }
+
+            static void render(std::string& out, const LineFields& fields, const LineFormat&)
+            {
+                if constexpr (count > 0)
+                    render(out, fields, std::make_index_sequence<count>{});
+                else
+                    out += '\n';
+            }
+        };
+    }
+
+    /**
+     * @brief Makes a LineFormat with a renderer generated for a format known at compile time.
+     *
+     * @note Use the EMBDL_LINE_FORMAT macro rather than calling this directly.
+     */
+    template <typename Source>
+    LineFormat static_line_format()
+    {
+        return LineFormat(Source::value(), &detail::StaticLineFormat<Source>::render);
+    }
+}
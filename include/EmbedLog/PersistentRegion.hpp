@@ -0,0 +1,132 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * PersistentRegion writes lines into memory that survives a warm reset, such
+ * as a noinit section, so the last moments before a watchdog reset can be
+ * recovered on the next boot.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <string>
+
+#if !defined(EMBEDLOG_NO_THREADS)
+#include <mutex>
+#endif
+
+namespace EmbedLog
+{
+    /**
+     * @class PersistentRegion
+     * @brief A ring of lines in a caller's memory region, recoverable after a reset.
+     *
+     * The region starts with a header checked by a hash, and each line carries a hash of
+     * its text and position. A line only becomes part of the ring once its text and hash
+     * are written, so a reset part way through loses just that line. Recovery skips lines
+     * that fail their check, and a region never written yields nothing rather than garbage.
+     * When the region is full the oldest lines are overwritten.
+     */
+    class PersistentRegion
+    {
+    public:
+        using LineFunction = std::function<void(const std::string&)>;
+
+        /**
+         * @brief Constructs a new PersistentRegion over memory that is left untouched until
+         * recover or reset.
+         *
+         * @param region The memory, such as a noinit section or a file mapped with mmap. It
+         * must stay in place for the life of the PersistentRegion.
+         * @param size The size of the region in bytes.
+         */
+        PersistentRegion(void* region, size_t size);
+
+        PersistentRegion(const PersistentRegion&) = delete;
+        PersistentRegion& operator=(const PersistentRegion&) = delete;
+
+        /**
+         * @brief Passes lines left in the region by the previous boot to a function, oldest first.
+         *
+         * @param consume Function taking each line.
+         * @return The number of lines recovered, or 0 if the region held none.
+         */
+        size_t recover(const LineFunction& consume) const;
+
+        /**
+         * @brief Empties the region and starts writing lines for this boot.
+         */
+        void reset();
+
+        /**
+         * @brief Writes a line, overwriting the oldest lines if the region is full.
+         *
+         * @param text The line.
+         * @param length The length of the line. Lines too long for the region are cut short.
+         *
+         * @note Does nothing until the region has been reset.
+         */
+        void write(const char* text, size_t length);
+
+        /**
+         * @brief Gets the number of boots the region has been reset for since it was first written.
+         */
+        uint32_t getBoot() const;
+
+    private:
+        struct Header
+        {
+            uint32_t magic;     // Marks the region as written by a PersistentRegion.
+            uint32_t boot;      // Number of resets since the region was first written.
+            uint64_t capacity;  // Bytes of lines after the header.
+            uint64_t head;      // Total bytes written, updated after each line.
+            uint64_t tail;      // Total bytes overwritten, updated before reusing them.
+            uint64_t check;     // Hash of magic, boot and capacity.
+        };
+
+        struct Entry
+        {
+            uint32_t length;    // Length of the line, or PADDING.
+            uint32_t check;     // Hash of the line and its position, written last.
+        };
+
+        static constexpr uint32_t PADDING = 0xFFFFFFFF;
+
+        // Checks the header was written for a region of this size
+        bool isValid() const;
+
+        // Gets the check for a line written at a position
+        static uint32_t lineCheck(const char* text, size_t length, uint64_t position);
+
+        Header* header;     // Start of the region, aligned to 8 bytes.
+        uint8_t* data;      // Lines, after the header.
+        size_t capacity;    // Bytes of lines the region holds.
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        std::mutex mutex;   // Guards writes from several threads.
+#endif
+    };
+}
@@ -0,0 +1,50 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Probes defines USDT static probes at the main points of the logging path.
+ * They are compiled in with the EMBEDLOG_USDT CMake option, cost a single
+ * nop until a tracer such as bpftrace or perf attaches, and compile to
+ * nothing otherwise.
+ *
+ */
+
+
+#pragma once
+
+// Static Probes
+// Every probe is in the "embedlog" provider:
+//   log_entry(level, enabled)   A log call was checked against the log level.
+//   sample(accepted)            A message was checked against the sample rate.
+//   throttle(id, accepted)      A message was checked against its throttle.
+//   format(level)               A message is about to be formatted.
+//   enqueue(level, size)        A message was captured into the deferred buffer.
+//   drop(size)                  A message was dropped because the deferred buffer was full.
+//   write(level, length)        A line is about to be passed to the print function.
+// For example: bpftrace -e 'usdt:./app:embedlog:write { @bytes = sum(arg1); }'
+#if defined(EMBEDLOG_USDT)
+#include <sys/sdt.h>
+#define EMBDL_PROBE1(name, a) DTRACE_PROBE1(embedlog, name, a)
+#define EMBDL_PROBE2(name, a, b) DTRACE_PROBE2(embedlog, name, a, b)
+#else
+#define EMBDL_PROBE1(name, a) ((void)0)
+#define EMBDL_PROBE2(name, a, b) ((void)0)
+#endif
@@ -0,0 +1,168 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * RecordRing is a bounded, lock-free ring buffer of variable length records.
+ * Any number of producers, including interrupt handlers, reserve and commit
+ * records, while a single consumer drains them in order.
+ *
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace EmbedLog
+{
+    /**
+     * @class RecordRing
+     * @brief A multi-producer, single-consumer ring buffer of byte records.
+     *
+     * Producers reserve space with a compare-and-swap on the write position, fill it in,
+     * then commit it with a release store, so records can be written from several threads
+     * or from interrupts without locks. Records never wrap around the end of the buffer.
+     * When the ring is full, new records are dropped and counted rather than blocking.
+     */
+    class RecordRing
+    {
+    public:
+        /**
+         * @brief Constructs a new RecordRing.
+         *
+         * @param capacity The size of the ring in bytes, rounded up to a power of two.
+         */
+        explicit RecordRing(size_t capacity);
+
+        /**
+         * @brief Reserves space for a record.
+         *
+         * @param size The number of bytes needed.
+         * @return A pointer to the reserved bytes, 8-byte aligned, or nullptr if the ring is full.
+         *
+         * @note Every successful reserve must be followed by a commit of the same pointer.
+         */
+        uint8_t* reserve(size_t size);
+
+        /**
+         * @brief Publishes a reserved record to the consumer.
+         *
+         * @param record The pointer returned by reserve.
+         */
+        void commit(uint8_t* record);
+
+        /**
+         * @brief Publishes a reserved record that used less space than it reserved.
+         *
+         * @param record The pointer returned by reserve.
+         * @param size The number of bytes used, no more than were reserved.
+         *
+         * @note The unused bytes stay claimed until the record is drained.
+         */
+        void commit(uint8_t* record, size_t size);
+
+        /**
+         * @brief Publishes a reserved record as empty, so the consumer skips it.
+         *
+         * @param record The pointer returned by reserve.
+         */
+        void discard(uint8_t* record);
+
+        /**
+         * @brief Passes every committed record to a function, in order, then frees them.
+         *
+         * @param consume Called as consume(const uint8_t* record, size_t size) for each record.
+         * @param limit Optional: The most records to consume.
+         * @return The number of records consumed.
+         *
+         * @note Draining stops at the first record that has been reserved but not yet
+         * committed. Only one thread may drain at a time.
+         */
+        template <typename Consumer>
+        size_t drain(Consumer&& consume, size_t limit = static_cast<size_t>(-1))
+        {
+            size_t count = 0;
+            uint64_t tail = readPosition.load(std::memory_order_relaxed);
+            while (count < limit)
+            {
+                Header* header = reinterpret_cast<Header*>(buffer + (tail & mask));
+                uint32_t total = header->total.load(std::memory_order_acquire);
+                if (total == 0)
+                    break;
+
+                if (header->size != PADDING)
+                {
+                    consume(reinterpret_cast<const uint8_t*>(header + 1), static_cast<size_t>(header->size));
+                    ++count;
+                }
+
+                release(header, total);
+                tail += total;
+                readPosition.store(tail, std::memory_order_release);
+            }
+            return count;
+        }
+
+        /**
+         * @brief Gets the number of records dropped because the ring was full.
+         *
+         * @return The number of dropped records.
+         */
+        uint64_t getDropped() const;
+
+        /**
+         * @brief Counts records dropped before reaching the ring, such as the rest of a
+         * group whose reservation failed.
+         *
+         * @param count The number of records.
+         */
+        void addDropped(uint64_t count);
+
+        /**
+         * @brief Gets the size of the ring.
+         *
+         * @return The capacity in bytes.
+         */
+        size_t getCapacity() const;
+
+    private:
+        struct Header
+        {
+            std::atomic<uint32_t> total; // Bytes used by the record and header, or 0 until committed.
+            uint32_t size;               // Bytes used by the record, or PADDING.
+        };
+
+        static constexpr uint32_t PADDING = 0xFFFFFFFF;
+
+        // Clears a consumed record so stale bytes are never mistaken for a committed header
+        void release(Header* header, uint32_t total);
+
+        std::unique_ptr<uint8_t[]> storage;        // Allocated memory, over-sized for alignment.
+        uint8_t* buffer;                           // Ring memory, 8-byte aligned.
+        uint64_t mask;                             // Capacity minus one.
+        std::atomic<uint64_t> writePosition{0};    // Total bytes reserved.
+        std::atomic<uint64_t> readPosition{0};     // Total bytes consumed.
+        std::atomic<uint64_t> dropped{0};          // Records dropped because the ring was full.
+    };
+} // namespace EmbedLog
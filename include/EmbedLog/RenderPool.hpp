@@ -0,0 +1,96 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * RenderPool is a small pool of threads that flush uses to format deferred
+ * messages in parallel. Without threads (EMBEDLOG_NO_THREADS) it runs every
+ * task on the calling thread.
+ *
+ */
+
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+#if !defined(EMBEDLOG_NO_THREADS)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+namespace EmbedLog
+{
+    /**
+     * @class RenderPool
+     * @brief Runs numbered tasks across a fixed set of threads, including the caller.
+     */
+    class RenderPool
+    {
+    public:
+        /**
+         * @brief Starts the pool.
+         *
+         * @param threads The number of threads that run tasks, including the one calling run.
+         */
+        explicit RenderPool(size_t threads);
+
+        RenderPool(const RenderPool&) = delete;
+        RenderPool& operator=(const RenderPool&) = delete;
+
+        /**
+         * @brief Stops and joins every thread.
+         */
+        ~RenderPool();
+
+        /**
+         * @brief Runs task(0) to task(count - 1), returning once all have finished.
+         *
+         * @param count The number of tasks.
+         * @param task The function to run for each task number.
+         */
+        void run(size_t count, const std::function<void(size_t)>& task);
+
+        /**
+         * @brief Gets the number of threads that run tasks, including the caller.
+         */
+        size_t getThreads() const;
+
+    private:
+#if !defined(EMBEDLOG_NO_THREADS)
+        // Runs tasks until none are left
+        void work();
+
+        std::vector<std::thread> workers;              // Threads besides the caller.
+        std::mutex mutex;                              // Guards everything below.
+        std::condition_variable started;               // Signalled when tasks are ready, or on stop.
+        std::condition_variable finished;              // Signalled when a worker runs out of tasks.
+        const std::function<void(size_t)>* current = nullptr; // Tasks being run.
+        size_t count = 0;                              // Number of tasks being run.
+        size_t next = 0;                               // Next task to hand out.
+        size_t busy = 0;                               // Workers still running tasks.
+        unsigned long long generation = 0;             // Incremented for each run.
+        bool stopping = false;                         // Set when the pool is destroyed.
+#endif
+    };
+}
@@ -0,0 +1,162 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * SinkQueue holds rendered lines for one extra sink, so a slow sink falls
+ * behind or drops lines on its own rather than holding up the log and its
+ * other sinks.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+#if !defined(EMBEDLOG_NO_THREADS)
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace EmbedLog
+{
+    /**
+     * @enum SinkPolicy
+     * @brief What a sink's queue does with a new line when it is full.
+     */
+    enum class SinkPolicy
+    {
+        DROP_OLDEST,  // Discard the oldest queued lines to make room.
+        DROP_NEWEST   // Discard the new line.
+    };
+
+    /**
+     * @struct SinkStats
+     * @brief How far behind a sink is.
+     */
+    struct SinkStats
+    {
+        uint64_t delivered = 0;   // Lines passed to the sink.
+        uint64_t dropped = 0;     // Lines discarded because the queue was full.
+        size_t queuedLines = 0;   // Lines waiting to be delivered.
+        size_t queuedBytes = 0;   // Bytes waiting to be delivered.
+        uint64_t lag = 0;         // Microseconds between the oldest waiting line and the newest line queued.
+    };
+
+    /**
+     * @class SinkQueue
+     * @brief A bounded queue of lines in front of one sink.
+     *
+     * The log pushes lines without waiting for the sink. Lines are delivered either by a
+     * thread of the queue's own or by calls to deliver, and the queue's lock is never held
+     * while the sink is writing.
+     */
+    class SinkQueue
+    {
+    public:
+        using SinkFunction = std::function<void(const std::string&)>;
+
+        /**
+         * @brief Constructs a new SinkQueue.
+         *
+         * @param sink Function that writes a line.
+         * @param capacity The most bytes of lines to hold.
+         * @param policy What to do when the queue is full.
+         * @param ownThread Whether to deliver lines on a thread of the queue's own. Ignored
+         * when built with EMBEDLOG_NO_THREADS.
+         */
+        SinkQueue(SinkFunction sink, size_t capacity, SinkPolicy policy, bool ownThread);
+
+        SinkQueue(const SinkQueue&) = delete;
+        SinkQueue& operator=(const SinkQueue&) = delete;
+
+        /**
+         * @brief Delivers any lines left, then stops the queue's thread.
+         */
+        ~SinkQueue();
+
+        /**
+         * @brief Queues a line, dropping lines by the queue's policy if it is full.
+         *
+         * @param timestamp The time the line was logged.
+         * @param text The line.
+         * @param length The length of the line.
+         */
+        void push(uint64_t timestamp, const char* text, size_t length);
+
+        /**
+         * @brief Passes waiting lines to the sink, oldest first.
+         *
+         * @param limit Optional: The most lines to deliver.
+         * @return The number of lines delivered.
+         */
+        size_t deliver(size_t limit = static_cast<size_t>(-1));
+
+        /**
+         * @brief Gets how far behind the sink is.
+         */
+        SinkStats getStats() const;
+
+    private:
+        struct Entry
+        {
+            uint64_t timestamp;  // Time the line was logged.
+            uint32_t length;     // Length of the line, or PADDING.
+            uint32_t reserved;   // Keeps entries 16 bytes aligned.
+        };
+
+        static constexpr uint32_t PADDING = 0xFFFFFFFF;
+
+        // Removes the oldest entry; the lock must be held
+        void popOldest();
+
+        // Moves an empty queue to the front of the buffer; the lock must be held
+        void restart();
+
+        // Finds the oldest entry, past any padding; the lock must be held
+        const Entry* oldest() const;
+
+        SinkFunction sink;                 // Function that writes a line.
+        std::unique_ptr<uint8_t[]> buffer; // Queued entries, each followed by its line.
+        size_t capacity;                   // Size of buffer in bytes.
+        uint64_t head = 0;                 // Total bytes written.
+        uint64_t tail = 0;                 // Total bytes read.
+        size_t lines = 0;                  // Lines waiting.
+        uint64_t newest = 0;               // Timestamp of the newest line queued.
+        uint64_t delivered = 0;            // Lines passed to the sink.
+        uint64_t dropped = 0;              // Lines discarded.
+        SinkPolicy policy;                 // What to do when full.
+        std::string line;                  // Line being delivered.
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        mutable std::mutex mutex;          // Guards the queue, but never the sink.
+        std::mutex delivering;             // Held while delivering, so lines stay in order.
+        std::condition_variable ready;     // Signalled when lines are queued, or on stop.
+        std::thread worker;                // Delivers lines, if the queue has its own thread.
+        bool stopping = false;             // Set when the queue is destroyed.
+#endif
+    };
+}
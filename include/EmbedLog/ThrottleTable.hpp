@@ -0,0 +1,122 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * ThrottleTable is a fixed-capacity, open-addressed table of throttle IDs
+ * and their last message times. Entries are reclaimed once their throttle
+ * window has passed, and the least recently logged entry is evicted when a
+ * neighbourhood is full, so memory stays bounded however many IDs are seen.
+ *
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+
+namespace EmbedLog
+{
+    /**
+     * @struct ThrottleStats
+     * @brief Occupancy statistics for a ThrottleTable.
+     */
+    struct ThrottleStats
+    {
+        size_t capacity = 0;      // Number of slots in the table.
+        size_t occupied = 0;      // Number of slots holding an ID.
+        uint64_t expirations = 0; // Entries reclaimed after their throttle window passed.
+        uint64_t evictions = 0;   // Entries evicted while still inside their throttle window.
+    };
+
+    /**
+     * @class ThrottleTable
+     * @brief A bounded map from throttle IDs to last message times.
+     *
+     * IDs are placed by hash and looked up with a short linear probe. When a new ID
+     * finds no free slot in its neighbourhood, an expired entry is reused if there is
+     * one, otherwise the least recently logged entry is evicted.
+     *
+     * The table is lock-free: slots are claimed and last message times updated with
+     * compare-and-swap, so any number of threads may call acquire at once. A claimed slot
+     * gets its times before its key is published, so races between threads can at worst
+     * let an extra message through. An optional per-thread cache
+     * remembers when recently suppressed IDs become due again, so repeatedly suppressed
+     * IDs are rejected without touching the shared table.
+     */
+    class ThrottleTable
+    {
+    public:
+        /**
+         * @brief Constructs a new ThrottleTable.
+         *
+         * @param capacity The maximum number of IDs to track, rounded up to a power of two.
+         * @param threadCache True to reject suppressed IDs from a per-thread cache first.
+         */
+        explicit ThrottleTable(size_t capacity, bool threadCache = true);
+
+        /**
+         * @brief Checks and updates the throttle state for an ID.
+         *
+         * @param id The throttle ID.
+         * @param window_us The minimum time in microseconds between messages.
+         * @param now_us The current time in microseconds.
+         * @return True if a message should be logged, in which case the window is restarted.
+         */
+        bool acquire(size_t id, uint64_t window_us, uint64_t now_us);
+
+        /**
+         * @brief Reclaims every entry whose throttle window has passed.
+         *
+         * @note This may run at the same time as acquire.
+         *
+         * @param now_us The current time in microseconds.
+         */
+        void expire(uint64_t now_us);
+
+        /**
+         * @brief Gets the occupancy statistics of the table.
+         *
+         * @return The current statistics.
+         */
+        ThrottleStats getStats() const;
+
+    private:
+        struct Slot
+        {
+            std::atomic<uint64_t> key{0};    // Throttle ID, or 0 if the slot is empty.
+            std::atomic<uint64_t> last{0};   // Time of the last message.
+            std::atomic<uint64_t> window{0}; // Throttle window of the last message.
+        };
+
+        static constexpr size_t PROBE_LENGTH = 8;
+
+        std::unique_ptr<Slot[]> slots;        // Slot storage.
+        size_t mask;                          // Capacity minus one.
+        uint64_t generation;                  // Distinguishes this table in the per-thread caches.
+        bool threadCache;                     // Whether the per-thread cache is used.
+        std::atomic<size_t> occupied{0};      // Number of slots holding an ID.
+        std::atomic<uint64_t> expirations{0}; // Entries reclaimed after their window passed.
+        std::atomic<uint64_t> evictions{0};   // Entries evicted inside their window.
+    };
+} // namespace EmbedLog
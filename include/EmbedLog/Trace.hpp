@@ -0,0 +1,60 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Trace writes span and instant events in the Chrome Trace Event format, so
+ * a log can also be opened as a timeline in chrome://tracing or Perfetto.
+ *
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace EmbedLog
+{
+    // Trace Event Phases
+    constexpr char TRACE_BEGIN = 'B';     // Start of a span.
+    constexpr char TRACE_END = 'E';       // End of a span.
+    constexpr char TRACE_COMPLETE = 'X';  // A whole span, with its duration.
+    constexpr char TRACE_INSTANT = 'i';   // A single point in time.
+
+    /**
+     * @brief Gets a small number identifying the calling thread.
+     *
+     * @return The thread's id, counting from 1 in the order threads first ask.
+     */
+    uint32_t trace_thread_id();
+
+    /**
+     * @brief Appends one trace event as a JSON object.
+     *
+     * @param out The string to append to.
+     * @param phase One of the TRACE_ phases.
+     * @param name The name of the event.
+     * @param timestamp The time of the event in microseconds.
+     * @param thread The id of the thread the event happened on.
+     * @param duration The length of a TRACE_COMPLETE span in microseconds.
+     */
+    void append_trace_event(std::string& out, char phase, const char* name, uint64_t timestamp, uint32_t thread, uint64_t duration);
+}
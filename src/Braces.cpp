@@ -0,0 +1,115 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Braces adds {} placeholder format strings. The format is parsed by the
+ * compiler into a list of text and argument segments, so rendering does no
+ * parsing at run-time and a format that does not match its arguments fails
+ * to compile.
+ *
+ */
+
+
+#include "EmbedLog/Braces.hpp"
+
+#include <charconv>
+#include <cstdio>
+
+namespace EmbedLog
+{
+    namespace
+    {
+        template <typename T>
+        void append_integer(std::string& out, T value, char spec)
+        {
+            char text[24];
+            char* end = std::to_chars(text, text + sizeof(text), value, spec == '\0' ? 10 : 16).ptr;
+            if (spec == 'X')
+            {
+                for (char* c = text; c != end; ++c)
+                {
+                    if (*c >= 'a' && *c <= 'f')
+                        *c = static_cast<char>(*c - 'a' + 'A');
+                }
+            }
+            out.append(text, end);
+        }
+
+        void append_arg(std::string& out, const ArgValue& arg, const FormatItem& item)
+        {
+            char text[64];
+            int length = 0;
+            switch (arg.type)
+            {
+            case ArgType::INT32:
+            case ArgType::INT64:
+                append_integer(out, arg.value.i, item.spec == '.' ? '\0' : item.spec);
+                return;
+            case ArgType::UINT32:
+            case ArgType::UINT64:
+                append_integer(out, arg.value.u, item.spec == '.' ? '\0' : item.spec);
+                return;
+            case ArgType::DOUBLE:
+                if (item.spec == '.')
+                    length = snprintf(text, sizeof(text), "%.*f", static_cast<int>(item.precision), arg.value.d);
+                else
+                    length = snprintf(text, sizeof(text), "%g", arg.value.d);
+                break;
+            case ArgType::POINTER:
+                length = snprintf(text, sizeof(text), "%p", arg.value.p);
+                break;
+            case ArgType::STATIC_STRING:
+            case ArgType::STRING:
+                out.append(arg.text, arg.size);
+                return;
+            case ArgType::CUSTOM:
+                arg.render(out, reinterpret_cast<const uint8_t*>(arg.text), arg.size);
+                return;
+            }
+
+            if (length > 0)
+                out.append(text, static_cast<size_t>(length) < sizeof(text) ? length : sizeof(text) - 1);
+        }
+    }
+
+    void render_braces(std::string& out, const BraceDescriptor& format, const ArgValue* args, size_t count)
+    {
+        for (size_t i = 0; i < format.count; ++i)
+        {
+            const FormatItem& item = format.items[i];
+            out.append(format.text + item.offset, item.length);
+            if (item.arg < 0)
+                continue;
+
+            if (static_cast<size_t>(item.arg) < count)
+                append_arg(out, args[item.arg], item);
+            else
+                out += "{}"; // Print the placeholder as is when its argument is missing
+        }
+    }
+
+    void render_braces(std::string& out, const BraceDescriptor& format, const uint8_t* args, size_t size)
+    {
+        ArgValue values[MAX_ARGS];
+        render_braces(out, format, values, decode_args(args, size, values, MAX_ARGS));
+    }
+
+} // namespace EmbedLog
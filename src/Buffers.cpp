@@ -0,0 +1,277 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Buffers provides argument wrappers for logging byte buffers as hex, and
+ * numeric arrays and ranges with an element limit. Each wrapper is formatted
+ * in a single write to the message, and is captured as raw bytes when
+ * logging is deferred, so the hex or decimal text is only produced on flush.
+ *
+ */
+
+
+#include "EmbedLog/Buffers.hpp"
+
+#include <charconv>
+#include <cstdio>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define EMBDL_HEX_SSE2
+#include <emmintrin.h>
+#include <tmmintrin.h>
+#if defined(__SSSE3__)
+#define EMBDL_HEX_SSSE3 1          // Always available.
+#elif defined(__GNUC__)
+#define EMBDL_HEX_SSSE3 2          // Chosen at run time.
+#endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#define EMBDL_HEX_NEON
+#include <arm_neon.h>
+#endif
+
+namespace EmbedLog
+{
+    namespace
+    {
+        constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+#if defined(EMBDL_HEX_SSE2)
+        // Encodes 16 bytes as 32 hex digits, in two vectors of 8 bytes each
+        inline void hex_digits(const uint8_t* data, __m128i& first, __m128i& second)
+        {
+            const __m128i nibble = _mm_set1_epi8(0x0F);
+            __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+            __m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble);
+            __m128i low = _mm_and_si128(bytes, nibble);
+
+            // '0' + n, plus the gap up to 'a' for n over 9
+            const __m128i zero = _mm_set1_epi8('0');
+            const __m128i nine = _mm_set1_epi8(9);
+            const __m128i gap = _mm_set1_epi8('a' - '0' - 10);
+            high = _mm_add_epi8(_mm_add_epi8(high, zero), _mm_and_si128(_mm_cmpgt_epi8(high, nine), gap));
+            low = _mm_add_epi8(_mm_add_epi8(low, zero), _mm_and_si128(_mm_cmpgt_epi8(low, nine), gap));
+
+            first = _mm_unpacklo_epi8(high, low);
+            second = _mm_unpackhi_epi8(high, low);
+        }
+#endif
+
+        // Encodes 16 bytes as 32 hex digits
+        void hex_block(char* out, const uint8_t* data)
+        {
+#if defined(EMBDL_HEX_SSE2)
+            __m128i first, second;
+            hex_digits(data, first, second);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out), first);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), second);
+#elif defined(EMBDL_HEX_NEON)
+            const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t*>(HEX_DIGITS));
+            uint8x16_t bytes = vld1q_u8(data);
+            uint8x16x2_t pairs;
+            pairs.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(bytes, 4));
+            pairs.val[1] = vqtbl1q_u8(digits, vandq_u8(bytes, vdupq_n_u8(0x0F)));
+            vst2q_u8(reinterpret_cast<uint8_t*>(out), pairs);
+#else
+            for (size_t i = 0; i < 16; ++i)
+            {
+                out[2 * i] = HEX_DIGITS[data[i] >> 4];
+                out[2 * i + 1] = HEX_DIGITS[data[i] & 0x0F];
+            }
+#endif
+        }
+
+#if defined(EMBDL_HEX_SSSE3)
+        // Where each of the 48 characters of a spaced block comes from: digit n of the first
+        // or second vector from hex_digits, or -128 for zero, so the separator can be ORed in
+        alignas(16) constexpr int8_t SPACED_FIRST[3][16] = {
+            {0, 1, -128, 2, 3, -128, 4, 5, -128, 6, 7, -128, 8, 9, -128, 10},
+            {11, -128, 12, 13, -128, 14, 15, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+            {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128}};
+        alignas(16) constexpr int8_t SPACED_SECOND[3][16] = {
+            {-128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128, -128},
+            {-128, -128, -128, -128, -128, -128, -128, -128, 0, 1, -128, 2, 3, -128, 4, 5},
+            {-128, 6, 7, -128, 8, 9, -128, 10, 11, -128, 12, 13, -128, 14, 15, -128}};
+        alignas(16) constexpr int8_t SPACED_SEPARATOR[3][16] = {
+            {0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0},
+            {0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0},
+            {-1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1, 0, 0, -1}};
+
+        // Encodes 16 bytes as 48 characters, each byte's digits followed by the separator
+#if EMBDL_HEX_SSSE3 == 2
+        __attribute__((target("ssse3")))
+#endif
+        void hex_spaced_block_ssse3(char* out, const uint8_t* data, char separator)
+        {
+            __m128i first, second;
+            hex_digits(data, first, second);
+            __m128i fill = _mm_set1_epi8(separator);
+            for (int i = 0; i < 3; ++i)
+            {
+                __m128i chars = _mm_or_si128(
+                    _mm_shuffle_epi8(first, _mm_load_si128(reinterpret_cast<const __m128i*>(SPACED_FIRST[i]))),
+                    _mm_shuffle_epi8(second, _mm_load_si128(reinterpret_cast<const __m128i*>(SPACED_SECOND[i]))));
+                chars = _mm_or_si128(chars, _mm_and_si128(fill, _mm_load_si128(reinterpret_cast<const __m128i*>(SPACED_SEPARATOR[i]))));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16 * i), chars);
+            }
+        }
+
+        bool has_ssse3()
+        {
+#if EMBDL_HEX_SSSE3 == 1
+            return true;
+#else
+            static const bool supported = []() {
+                __builtin_cpu_init();
+                return __builtin_cpu_supports("ssse3") != 0;
+            }();
+            return supported;
+#endif
+        }
+#endif
+
+        // Encodes 16 bytes as 48 characters, each byte's digits followed by the separator
+        void hex_spaced_block(char* out, const uint8_t* data, char separator)
+        {
+#if defined(EMBDL_HEX_SSSE3)
+            if (has_ssse3())
+            {
+                hex_spaced_block_ssse3(out, data, separator);
+                return;
+            }
+#endif
+#if defined(EMBDL_HEX_NEON)
+            const uint8x16_t digits = vld1q_u8(reinterpret_cast<const uint8_t*>(HEX_DIGITS));
+            uint8x16_t bytes = vld1q_u8(data);
+            uint8x16x3_t triples;
+            triples.val[0] = vqtbl1q_u8(digits, vshrq_n_u8(bytes, 4));
+            triples.val[1] = vqtbl1q_u8(digits, vandq_u8(bytes, vdupq_n_u8(0x0F)));
+            triples.val[2] = vdupq_n_u8(static_cast<uint8_t>(separator));
+            vst3q_u8(reinterpret_cast<uint8_t*>(out), triples);
+#else
+            // Encode the digits 16 bytes at a time, then spread them out
+            char pairs[32];
+            hex_block(pairs, data);
+            for (size_t i = 0; i < 16; ++i)
+            {
+                out[3 * i] = pairs[2 * i];
+                out[3 * i + 1] = pairs[2 * i + 1];
+                out[3 * i + 2] = separator;
+            }
+#endif
+        }
+    }
+
+    void append_hex(std::string& out, const uint8_t* data, size_t size, char separator)
+    {
+        if (size == 0)
+            return;
+
+        size_t offset = out.size();
+        size_t stride = separator ? 3 : 2;
+        out.resize(offset + size * stride - (separator ? 1 : 0));
+        char* next = &out[offset];
+
+        if (!separator)
+        {
+            for (; size >= 16; size -= 16, data += 16, next += 32)
+                hex_block(next, data);
+        }
+        else
+        {
+            // Blocks end with a separator, so one is only used while a byte follows it
+            for (; size > 16; size -= 16, data += 16, next += 48)
+                hex_spaced_block(next, data, separator);
+        }
+
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (separator && i != 0)
+                *next++ = separator;
+            *next++ = HEX_DIGITS[data[i] >> 4];
+            *next++ = HEX_DIGITS[data[i] & 0x0F];
+        }
+    }
+
+    namespace detail
+    {
+        void append_number(std::string& out, int64_t value)
+        {
+            char text[24];
+            out.append(text, std::to_chars(text, text + sizeof(text), value).ptr);
+        }
+
+        void append_number(std::string& out, uint64_t value)
+        {
+            char text[24];
+            out.append(text, std::to_chars(text, text + sizeof(text), value).ptr);
+        }
+
+        void append_number(std::string& out, double value)
+        {
+            char text[32];
+            int length = snprintf(text, sizeof(text), "%g", value);
+            if (length > 0)
+                out.append(text, static_cast<size_t>(length) < sizeof(text) ? length : sizeof(text) - 1);
+        }
+
+        void append_more(std::string& out, size_t hidden)
+        {
+            if (hidden == 0)
+                return;
+
+            out += " ...(+";
+            append_number(out, static_cast<uint64_t>(hidden));
+            out += ')';
+        }
+    }
+
+    // Hex bytes are captured as the total size, the separator, then the shown bytes
+    void Formatter<HexBytes>::format(std::string& out, const HexBytes& bytes)
+    {
+        size_t shown = bytes.size < bytes.limit ? bytes.size : bytes.limit;
+        append_hex(out, bytes.data, shown, bytes.separator);
+        detail::append_more(out, bytes.size - shown);
+    }
+
+    size_t Formatter<HexBytes>::size(const HexBytes& bytes)
+    {
+        size_t shown = bytes.size < bytes.limit ? bytes.size : bytes.limit;
+        return sizeof(uint32_t) + 1 + shown;
+    }
+
+    void Formatter<HexBytes>::encode(uint8_t* out, const HexBytes& bytes)
+    {
+        uint32_t total = static_cast<uint32_t>(bytes.size);
+        std::memcpy(out, &total, sizeof(total));
+        out[sizeof(total)] = static_cast<uint8_t>(bytes.separator);
+        std::memcpy(out + sizeof(total) + 1, bytes.data, size(bytes) - sizeof(total) - 1);
+    }
+
+    void Formatter<HexBytes>::decode(std::string& out, const uint8_t* data, size_t size)
+    {
+        uint32_t total;
+        std::memcpy(&total, data, sizeof(total));
+        size_t shown = size - sizeof(total) - 1;
+        append_hex(out, data + sizeof(total) + 1, shown, static_cast<char>(data[sizeof(total)]));
+        detail::append_more(out, total - shown);
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,159 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * CallSite holds the per call site state used by the EMBDL_* logging macros,
+ * including a run-time enable flag and a call counter, and keeps a registry
+ * so call sites can be switched on and off by file and line.
+ *
+ */
+
+#include "EmbedLog/CallSite.hpp"
+
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if !defined(EMBEDLOG_NO_THREADS)
+#include <mutex>
+#endif
+
+#if defined(EMBEDLOG_NO_THREADS)
+#define EMBDL_CALL_SITE_LOCK(m)
+#else
+#define EMBDL_CALL_SITE_LOCK(m) std::lock_guard<std::mutex> embdl_lock(m)
+#endif
+
+namespace EmbedLog
+{
+    namespace
+    {
+        // Rules kept beyond this drop the oldest; they only matter to call sites not reached yet
+        constexpr size_t MAX_CALL_SITE_RULES = 256;
+
+        // A rule recorded by set_call_site_enabled, kept so call sites reached later also follow it
+        struct CallSiteRule
+        {
+            std::string file;
+            int line;
+            bool enabled;
+        };
+
+        // Every call site and rule, guarded together so a new call site cannot miss a rule
+        struct CallSiteRegistry
+        {
+            CallSite* sites = nullptr;       // Every call site, newest first.
+            std::vector<CallSiteRule> rules; // Every rule, oldest first.
+#if !defined(EMBEDLOG_NO_THREADS)
+            std::mutex mutex;
+#endif
+        };
+
+        // Never destroyed, so call sites reached by static destructors can still register
+        CallSiteRegistry& call_site_registry()
+        {
+            static CallSiteRegistry* registry = new CallSiteRegistry();
+            return *registry;
+        }
+
+        bool matches(const char* siteFile, int siteLine, const char* file, int line)
+        {
+            if (line != 0 && line != siteLine)
+                return false;
+
+            size_t siteLength = std::strlen(siteFile);
+            size_t length = std::strlen(file);
+            if (length > siteLength || std::strcmp(siteFile + siteLength - length, file) != 0)
+                return false;
+
+            // The match must cover whole path components, so "foo.cpp" does not match "barfoo.cpp".
+            char before = length < siteLength ? siteFile[siteLength - length - 1] : '/';
+            return before == '/' || before == '\\';
+        }
+    }
+
+    CallSite::CallSite(const char* file, int line)
+        : file(file),
+          line(line)
+    {
+        CallSiteRegistry& registry = call_site_registry();
+        EMBDL_CALL_SITE_LOCK(registry.mutex);
+
+        // The most recent matching rule wins
+        for (size_t i = registry.rules.size(); i-- > 0;)
+        {
+            const CallSiteRule& rule = registry.rules[i];
+            if (matches(file, line, rule.file.c_str(), rule.line))
+            {
+                enabled.store(rule.enabled, std::memory_order_relaxed);
+                break;
+            }
+        }
+
+        next = registry.sites;
+        registry.sites = this;
+    }
+
+    void set_call_site_enabled(const char* file, int line, bool enabled)
+    {
+        CallSiteRegistry& registry = call_site_registry();
+        EMBDL_CALL_SITE_LOCK(registry.mutex);
+
+        // Drop rules the new one replaces: the same pattern, or any line of a file it covers whole
+        std::vector<CallSiteRule>& rules = registry.rules;
+        size_t kept = 0;
+        for (size_t i = 0; i < rules.size(); ++i)
+        {
+            if (rules[i].file == file && (line == 0 || rules[i].line == line))
+                continue;
+            if (kept != i)
+                rules[kept] = std::move(rules[i]);
+            ++kept;
+        }
+        rules.resize(kept);
+
+        if (rules.size() >= MAX_CALL_SITE_RULES)
+            rules.erase(rules.begin());
+        rules.push_back(CallSiteRule{file, line, enabled});
+
+        for (CallSite* site = registry.sites; site; site = site->next)
+        {
+            if (matches(site->file, site->line, file, line))
+                site->setEnabled(enabled);
+        }
+    }
+
+    bool accept_every_n(CallSiteCounter& counter, uint32_t n)
+    {
+        return n != 0 && counter.fetch_add(1, std::memory_order_relaxed) % n == 0;
+    }
+
+    bool accept_first_n(CallSiteCounter& counter, uint32_t n)
+    {
+        // Check before incrementing so a long-lived call site never wraps the counter
+        if (counter.load(std::memory_order_relaxed) >= n)
+            return false;
+
+        return counter.fetch_add(1, std::memory_order_relaxed) < n;
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,342 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Capture encodes log arguments into compact, self-describing bytes so a
+ * message can be formatted later. String literals are kept by pointer, run-
+ * time strings are copied, user types serialise themselves through the
+ * Serializer trait, and format strings are checked against their arguments
+ * at compile time.
+ *
+ */
+
+
+#include "EmbedLog/Capture.hpp"
+
+#include <cstdio>
+
+namespace EmbedLog
+{
+    namespace
+    {
+        template <typename T>
+        T load(const uint8_t* data)
+        {
+            T value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        // Appends a single snprintf conversion to a string
+        template <typename T>
+        void append_formatted(std::string& out, const char* spec, int stars, const int* starValues, T value)
+        {
+            char small[64];
+            int length;
+            switch (stars)
+            {
+            case 0:
+                length = snprintf(small, sizeof(small), spec, value);
+                break;
+            case 1:
+                length = snprintf(small, sizeof(small), spec, starValues[0], value);
+                break;
+            default:
+                length = snprintf(small, sizeof(small), spec, starValues[0], starValues[1], value);
+                break;
+            }
+
+            if (length < 0)
+                return;
+
+            if (static_cast<size_t>(length) < sizeof(small))
+            {
+                out.append(small, length);
+                return;
+            }
+
+            size_t offset = out.size();
+            out.resize(offset + length + 1);
+            switch (stars)
+            {
+            case 0:
+                snprintf(&out[offset], length + 1, spec, value);
+                break;
+            case 1:
+                snprintf(&out[offset], length + 1, spec, starValues[0], value);
+                break;
+            default:
+                snprintf(&out[offset], length + 1, spec, starValues[0], starValues[1], value);
+                break;
+            }
+            out.resize(offset + length);
+        }
+
+        // Appends a string with printf style width, precision and justification
+        void append_string(std::string& out, const char* spec, int stars, const int* starValues, const char* text, size_t size)
+        {
+            bool left = false;
+            int width = 0;
+            int precision = -1;
+            int star = 0;
+
+            const char* p = spec + 1;
+            while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0')
+                left |= *p++ == '-';
+            if (*p == '*')
+            {
+                width = star < stars ? starValues[star++] : 0;
+                ++p;
+            }
+            while (*p >= '0' && *p <= '9')
+                width = width * 10 + (*p++ - '0');
+            if (*p == '.')
+            {
+                ++p;
+                precision = 0;
+                if (*p == '*')
+                {
+                    precision = star < stars ? starValues[star++] : -1;
+                    ++p;
+                }
+                while (*p >= '0' && *p <= '9')
+                    precision = precision * 10 + (*p++ - '0');
+            }
+            if (width < 0)
+            {
+                left = true;
+                width = -width;
+            }
+
+            if (precision >= 0 && static_cast<size_t>(precision) < size)
+                size = static_cast<size_t>(precision);
+            size_t padding = static_cast<size_t>(width) > size ? static_cast<size_t>(width) - size : 0;
+
+            if (!left)
+                out.append(padding, ' ');
+            out.append(text, size);
+            if (left)
+                out.append(padding, ' ');
+        }
+
+        int to_int(const ArgValue& arg)
+        {
+            switch (arg.type)
+            {
+            case ArgType::INT32:
+            case ArgType::INT64:
+                return static_cast<int>(arg.value.i);
+            case ArgType::UINT32:
+            case ArgType::UINT64:
+                return static_cast<int>(arg.value.u);
+            default:
+                return 0;
+            }
+        }
+
+        bool is_integer_conversion(char conversion)
+        {
+            return std::strchr("diuoxXc", conversion) != nullptr;
+        }
+
+        bool is_floating_conversion(char conversion)
+        {
+            return std::strchr("fFeEgGaA", conversion) != nullptr;
+        }
+    }
+
+    size_t decode_args(const uint8_t* data, size_t size, ArgValue* args, size_t count)
+    {
+        const uint8_t* end = data + size;
+        size_t decoded = 0;
+        while (data < end && decoded < count)
+        {
+            ArgValue& arg = args[decoded];
+            arg.type = static_cast<ArgType>(*data++);
+
+            size_t length;
+            switch (arg.type)
+            {
+            case ArgType::INT32:
+                arg.value.i = load<int32_t>(data);
+                length = sizeof(int32_t);
+                break;
+            case ArgType::UINT32:
+                arg.value.u = load<uint32_t>(data);
+                length = sizeof(uint32_t);
+                break;
+            case ArgType::INT64:
+                arg.value.i = load<int64_t>(data);
+                length = sizeof(int64_t);
+                break;
+            case ArgType::UINT64:
+                arg.value.u = load<uint64_t>(data);
+                length = sizeof(uint64_t);
+                break;
+            case ArgType::DOUBLE:
+                arg.value.d = load<double>(data);
+                length = sizeof(double);
+                break;
+            case ArgType::POINTER:
+                arg.value.p = reinterpret_cast<const void*>(load<uintptr_t>(data));
+                length = sizeof(uintptr_t);
+                break;
+            case ArgType::STATIC_STRING:
+                arg.text = load<const char*>(data);
+                arg.size = std::strlen(arg.text);
+                length = sizeof(const char*);
+                break;
+            case ArgType::CUSTOM:
+                arg.render = load<RenderFunction>(data);
+                data += sizeof(RenderFunction);
+                [[fallthrough]]; // Custom values are sized like strings
+            case ArgType::STRING:
+                length = load<uint32_t>(data);
+                data += sizeof(uint32_t);
+                arg.text = reinterpret_cast<const char*>(data);
+                arg.size = arg.type == ArgType::STRING ? length - 1 : length; // Strings are captured with a terminator
+                break;
+            default:
+                return decoded;
+            }
+
+            data += length;
+            if (data > end)
+                return decoded;
+            ++decoded;
+        }
+        return decoded;
+    }
+
+    void render_format(std::string& out, const char* format, const ArgValue* args, size_t count)
+    {
+        const ArgValue* end = args + count;
+
+        while (*format)
+        {
+            const char* start = format;
+            if (*format != '%')
+            {
+                while (*format && *format != '%')
+                    ++format;
+                out.append(start, format - start);
+                continue;
+            }
+
+            ++format;
+            if (*format == '%')
+            {
+                out += '%';
+                ++format;
+                continue;
+            }
+
+            // Copy the flags, width and precision, leaving out any length modifiers
+            char spec[32];
+            size_t specLength = 0;
+            spec[specLength++] = '%';
+
+            int stars = 0;
+            int starValues[2] = {0, 0};
+            bool missing = false;
+            while (*format && std::strchr("-+ #0123456789.*", *format))
+            {
+                if (*format == '*' && stars < 2)
+                {
+                    if (args < end)
+                        starValues[stars++] = to_int(*args++);
+                    else
+                        missing = true;
+                }
+                if (specLength < sizeof(spec) - 4)
+                    spec[specLength++] = *format;
+                ++format;
+            }
+            while (*format && std::strchr("hlLjzt", *format))
+                ++format;
+
+            char conversion = *format;
+            if (conversion)
+                ++format;
+
+            if (missing || !conversion || args == end)
+            {
+                out.append(start, format - start); // Print the conversion as is when its argument is missing
+                continue;
+            }
+
+            // Use the conversion if it suits the argument's type, otherwise the type's default conversion
+            const ArgValue& arg = *args++;
+            switch (arg.type)
+            {
+            case ArgType::INT32:
+                spec[specLength++] = is_integer_conversion(conversion) ? conversion : 'd';
+                spec[specLength] = '\0';
+                append_formatted(out, spec, stars, starValues, static_cast<int>(arg.value.i));
+                break;
+            case ArgType::UINT32:
+                spec[specLength++] = is_integer_conversion(conversion) ? conversion : 'u';
+                spec[specLength] = '\0';
+                append_formatted(out, spec, stars, starValues, static_cast<unsigned int>(arg.value.u));
+                break;
+            case ArgType::INT64:
+                spec[specLength++] = 'l';
+                spec[specLength++] = 'l';
+                spec[specLength++] = is_integer_conversion(conversion) && conversion != 'c' ? conversion : 'd';
+                spec[specLength] = '\0';
+                append_formatted(out, spec, stars, starValues, static_cast<long long>(arg.value.i));
+                break;
+            case ArgType::UINT64:
+                spec[specLength++] = 'l';
+                spec[specLength++] = 'l';
+                spec[specLength++] = is_integer_conversion(conversion) && conversion != 'c' ? conversion : 'u';
+                spec[specLength] = '\0';
+                append_formatted(out, spec, stars, starValues, static_cast<unsigned long long>(arg.value.u));
+                break;
+            case ArgType::DOUBLE:
+                spec[specLength++] = is_floating_conversion(conversion) ? conversion : 'g';
+                spec[specLength] = '\0';
+                append_formatted(out, spec, stars, starValues, arg.value.d);
+                break;
+            case ArgType::POINTER:
+                spec[specLength++] = 'p';
+                spec[specLength] = '\0';
+                append_formatted(out, spec, stars, starValues, const_cast<void*>(arg.value.p));
+                break;
+            case ArgType::STATIC_STRING:
+            case ArgType::STRING:
+                spec[specLength] = '\0';
+                append_string(out, spec, stars, starValues, arg.text, arg.size);
+                break;
+            case ArgType::CUSTOM:
+                arg.render(out, reinterpret_cast<const uint8_t*>(arg.text), arg.size);
+                break;
+            }
+        }
+    }
+
+    void render_format(std::string& out, const char* format, const uint8_t* args, size_t size)
+    {
+        ArgValue values[MAX_ARGS];
+        render_format(out, format, values, decode_args(args, size, values, MAX_ARGS));
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,206 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Compress is a small LZ77 block compressor in the style of LZ4, used to
+ * keep more log history in the same RAM. It favours speed and a tiny
+ * footprint over ratio.
+ *
+ */
+
+
+#include "EmbedLog/Compress.hpp"
+
+#include <cstring>
+
+// A compressed block is a series of sequences. Each starts with a token whose high
+// nibble is the literal length and low nibble the match length minus 4, where 15 means
+// more length bytes follow (each adding up to 255). Then come the literals, a 16-bit
+// little-endian offset back to the match, and any extra match length bytes. The last
+// sequence has literals only.
+
+namespace EmbedLog
+{
+    namespace
+    {
+        constexpr size_t MIN_MATCH = 4;
+        constexpr size_t MAX_OFFSET = 65535;
+        constexpr int HASH_BITS = 10;
+
+        static_assert(COMPRESS_TABLE_SIZE == 1 << HASH_BITS, "Table size must match the hash");
+
+        uint32_t read32(const uint8_t* data)
+        {
+            uint32_t value;
+            std::memcpy(&value, data, sizeof(value));
+            return value;
+        }
+
+        uint32_t hash(uint32_t value)
+        {
+            return (value * 2654435761u) >> (32 - HASH_BITS);
+        }
+
+        // Writes a length that did not fit in its token nibble
+        bool write_length(uint8_t*& out, uint8_t* end, size_t length)
+        {
+            for (; length >= 255; length -= 255)
+            {
+                if (out == end)
+                    return false;
+                *out++ = 255;
+            }
+            if (out == end)
+                return false;
+            *out++ = static_cast<uint8_t>(length);
+            return true;
+        }
+
+        bool read_length(const uint8_t*& in, const uint8_t* end, size_t& length)
+        {
+            uint8_t byte;
+            do
+            {
+                if (in == end)
+                    return false;
+                byte = *in++;
+                length += byte;
+            } while (byte == 255);
+            return true;
+        }
+
+        bool write_sequence(uint8_t*& out, uint8_t* end, const uint8_t* literals, size_t literalLength,
+                            size_t offset, size_t matchLength)
+        {
+            if (out == end)
+                return false;
+
+            size_t match = matchLength ? matchLength - MIN_MATCH : 0;
+            uint8_t* token = out++;
+            *token = static_cast<uint8_t>((literalLength < 15 ? literalLength : 15) << 4 | (match < 15 ? match : 15));
+
+            if (literalLength >= 15 && !write_length(out, end, literalLength - 15))
+                return false;
+            if (static_cast<size_t>(end - out) < literalLength)
+                return false;
+            if (literalLength)
+                std::memcpy(out, literals, literalLength);
+            out += literalLength;
+
+            if (!matchLength)
+                return true;
+
+            if (end - out < 2)
+                return false;
+            *out++ = static_cast<uint8_t>(offset);
+            *out++ = static_cast<uint8_t>(offset >> 8);
+            return match < 15 || write_length(out, end, match - 15);
+        }
+    }
+
+    size_t compress_block(const uint8_t* in, size_t size, uint8_t* out, size_t capacity, uint16_t* table)
+    {
+        if (size > COMPRESS_MAX_BLOCK)
+            return 0;
+
+        // Position + 1 of the last sequence with each hash
+        std::memset(table, 0, COMPRESS_TABLE_SIZE * sizeof(uint16_t));
+        uint8_t* next = out;
+        uint8_t* end = out + capacity;
+
+        size_t anchor = 0;
+        size_t position = 0;
+        while (position + MIN_MATCH <= size)
+        {
+            uint32_t sequence = read32(in + position);
+            uint16_t& slot = table[hash(sequence)];
+            size_t candidate = slot;
+            slot = static_cast<uint16_t>(position + 1);
+
+            if (candidate == 0 || position - (candidate - 1) > MAX_OFFSET || read32(in + candidate - 1) != sequence)
+            {
+                ++position;
+                continue;
+            }
+
+            size_t match = candidate - 1;
+            size_t length = MIN_MATCH;
+            while (position + length < size && in[match + length] == in[position + length])
+                ++length;
+
+            if (!write_sequence(next, end, in + anchor, position - anchor, position - match, length))
+                return 0;
+
+            position += length;
+            anchor = position;
+        }
+
+        if (!write_sequence(next, end, in + anchor, size - anchor, 0, 0))
+            return 0;
+        return static_cast<size_t>(next - out);
+    }
+
+    size_t decompress_block(const uint8_t* in, size_t size, uint8_t* out, size_t capacity)
+    {
+        const uint8_t* end = in + size;
+        uint8_t* next = out;
+        uint8_t* limit = out + capacity;
+
+        while (in < end)
+        {
+            uint8_t token = *in++;
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !read_length(in, end, literalLength))
+                return 0;
+            if (static_cast<size_t>(end - in) < literalLength || static_cast<size_t>(limit - next) < literalLength)
+                return 0;
+            std::memcpy(next, in, literalLength);
+            in += literalLength;
+            next += literalLength;
+
+            if (in == end)
+                break; // The last sequence has no match
+
+            if (end - in < 2)
+                return 0;
+            size_t offset = in[0] | static_cast<size_t>(in[1]) << 8;
+            in += 2;
+
+            size_t matchLength = token & 0xF;
+            if (matchLength == 15 && !read_length(in, end, matchLength))
+                return 0;
+            matchLength += MIN_MATCH;
+
+            if (offset == 0 || offset > static_cast<size_t>(next - out) || static_cast<size_t>(limit - next) < matchLength)
+                return 0;
+
+            // Byte by byte, as a match may overlap the bytes it is copying
+            const uint8_t* match = next - offset;
+            for (size_t i = 0; i < matchLength; ++i)
+                next[i] = match[i];
+            next += matchLength;
+        }
+
+        return static_cast<size_t>(next - out);
+    }
+
+} // namespace EmbedLog
@@ -29,12 +29,208 @@
 
 #include "EmbedLog/EmbedLog.hpp"
 
-#include <iomanip>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#if !defined(EMBEDLOG_NO_THREADS)
+#include <mutex>
+#include <thread>
+#endif
+
+#if defined(EMBEDLOG_NO_THREADS)
+#define EMBDL_TRACE_LOCK(m)
+#else
+#define EMBDL_TRACE_LOCK(m) std::lock_guard<std::mutex> embdl_lock(m)
+#endif
 
 namespace EmbedLog
 {
-    uint64_t unique_id(std::string file, int line) {
-        return std::hash<std::string>{}(file + std::to_string(line));
+    // Messages gathered by one thread before being published together
+    struct EmbedLog::ThreadStage
+    {
+        ThreadStage(const void* thread, size_t capacity)
+            : thread(thread), data(new uint8_t[capacity])
+        {
+        }
+
+        std::atomic<uint8_t> state{0};    // STAGE_FREE, or who holds the stage.
+        std::atomic<const void*> thread;  // Thread the stage belongs to, as the address of its cache, or nullptr once it exits.
+        size_t size = 0;                  // Bytes of messages gathered.
+        uint32_t count = 0;               // Messages gathered.
+        std::unique_ptr<uint8_t[]> data;  // Gathered messages, as DeferredRecords, or nullptr once the thread exits.
+        ThreadStage* next = nullptr;      // Next stage of the same log.
+    };
+
+    // Lines formatted by renderDeferred, waiting to be printed
+    struct EmbedLog::Rendered
+    {
+        struct Line
+        {
+            size_t end;          // End of the line in text.
+            uint64_t timestamp;  // Time the line was logged.
+            uint16_t level;      // Log level of the line.
+            bool trace;          // Whether the line is a trace event.
+        };
+
+        std::string text;         // Every line, one after another.
+        std::vector<Line> lines;  // Where each line ends.
+        std::string message;      // Scratch space for formatting and printing.
+        LineClock clock;          // Timestamp of the last line, carried on to the next.
+
+        void clear()
+        {
+            text.clear();
+            lines.clear();
+        }
+    };
+
+    // Buffers and threads used by flush
+    struct EmbedLog::FlushState
+    {
+        std::vector<Rendered> workers = std::vector<Rendered>(1);  // Lines formatted by each thread.
+        std::vector<uint8_t> records;                              // Records copied out of the ring.
+        std::vector<size_t> offsets;                               // Start of each copied record.
+        std::unique_ptr<RenderPool> pool;                          // Formatting threads, if any.
+    };
+
+    namespace
+    {
+        constexpr uint64_t SAMPLE_ALWAYS = 1ull << 32;
+
+        // Bytes of the sample rate captured after a sampled message's arguments: its type, then its value
+        constexpr uint32_t SAMPLE_RATE_SIZE = 1 + sizeof(double);
+
+        // Records formatted per round when flushing on several threads
+        constexpr size_t FLUSH_CHUNK = 4096;
+
+        std::atomic<uint64_t> nextStageGeneration{1};
+
+        // Who holds a thread's stage
+        constexpr uint8_t STAGE_FREE = 0;
+        constexpr uint8_t STAGE_WRITING = 1;   // The owning thread, adding a message.
+        constexpr uint8_t STAGE_SWEEPING = 2;  // Flush, publishing the stage.
+
+        // The stage the calling thread last used, valid while the generation matches
+        struct ThreadStageCache
+        {
+            uint64_t generation = 0;
+            void* stage = nullptr;
+        };
+
+        thread_local ThreadStageCache threadStageCache;
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        // The generations whose stages have not been deleted, so exiting threads only retire
+        // stages that still exist; never destroyed, as threads may exit during static destruction
+        struct StageRegistry
+        {
+            std::mutex mutex;
+            std::vector<uint64_t> live;
+        };
+
+        StageRegistry& stage_registry()
+        {
+            static StageRegistry* registry = new StageRegistry();
+            return *registry;
+        }
+
+        bool is_live(const StageRegistry& registry, uint64_t generation)
+        {
+            return std::find(registry.live.begin(), registry.live.end(), generation) != registry.live.end();
+        }
+#endif
+
+        // Tags a sampled message so the rate can be used to re-weight counts
+        void append_sample_tag(std::string& message, double rate)
+        {
+            char tag[32];
+            snprintf(tag, sizeof(tag), " [sample=%.9g]", rate);
+            message += tag;
+        }
+
+        // Converts a rate in [0, 1] to a threshold for a 32-bit random number
+        uint64_t sample_threshold(double rate)
+        {
+            if (!(rate > 0.0))
+                return 0;
+            if (rate >= 1.0)
+                return SAMPLE_ALWAYS;
+            return static_cast<uint64_t>(rate * static_cast<double>(SAMPLE_ALWAYS));
+        }
+
+        // Returns true with a probability of threshold / 2^32, using a per-thread xorshift generator
+        bool sample_threshold_passes(uint64_t threshold)
+        {
+            if (threshold >= SAMPLE_ALWAYS)
+                return true;
+
+            static std::atomic<uint32_t> seed{0x9E3779B9u};
+            thread_local uint32_t state = seed.fetch_add(0x6D2B79F5u, std::memory_order_relaxed) | 1u;
+
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            return state < threshold;
+        }
+    }
+
+    // The parts of a log only some applications use, kept out of line so the core stays small
+    struct EmbedLog::Extensions
+    {
+        std::atomic<ThreadStage*> stages{nullptr};      // Every thread's stage, newest first.
+        uint64_t stageGeneration = nextStageGeneration.fetch_add(1, std::memory_order_relaxed); // Identifies this log's stages in the per-thread cache.
+        std::unique_ptr<FlushState> flushState;         // Buffers and threads used by flush, made on first use.
+        std::vector<std::unique_ptr<SinkQueue>> sinks;  // Extra sinks, each with its own queue.
+        std::unique_ptr<FlightRecorder> recorder;       // History of flushed messages, if recording.
+        std::unique_ptr<PersistentRegion> persistent;   // Memory lines are kept in across resets, if any.
+        std::unique_ptr<FlashStore> flashStore;         // Flash lines are stored in, if any.
+        size_t recoveredLines = 0;                      // Lines recovered from the persistent region.
+        bool persistentStarted = false;                 // Whether the region has been recovered since it was set.
+        bool recorderPrints = true;                     // Whether flush prints messages as well as recording them.
+        bool traceStarted = false;                      // Whether the opening bracket of the trace has been written.
+        PrintFunction traceFunc;                        // Function for writing trace events, if tracing.
+#if !defined(EMBEDLOG_NO_THREADS)
+        std::mutex traceMutex;                          // Guards traceStarted and traceFunc while writing.
+#endif
+    };
+
+#if !defined(EMBEDLOG_NO_THREADS)
+    // The stages a thread has gathered messages in, retired when the thread exits
+    struct EmbedLog::ThreadStageOwner
+    {
+        struct Owned
+        {
+            EmbedLog* log;
+            uint64_t generation;
+            ThreadStage* stage;
+        };
+
+        std::vector<Owned> stages;
+
+        ~ThreadStageOwner()
+        {
+            StageRegistry& registry = stage_registry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (const Owned& owned : stages)
+            {
+                if (is_live(registry, owned.generation))
+                    owned.log->retireStage(owned.stage);
+            }
+        }
+
+        static ThreadStageOwner& current()
+        {
+            thread_local ThreadStageOwner owner;
+            return owner;
+        }
+    };
+#endif
+
+    bool accept_sample(double rate)
+    {
+        return sample_threshold_passes(sample_threshold(rate));
     }
 
     EmbedLog::EmbedLog(OpenFunction openFunc,
@@ -43,152 +239,921 @@ namespace EmbedLog
                        MicrosecondFunction microsecondFunc,
                        std::string name,
                        std::string format)
-        : openFunc(openFunc),
-          closeFunc(closeFunc),
-          printFunc(printFunc),
-          microsecondFunc(microsecondFunc),
-          name(name),
-          format(format)
+        : config(std::make_shared<const Config>(Config{std::move(openFunc),
+                                                       std::move(closeFunc),
+                                                       std::move(printFunc),
+                                                       std::move(microsecondFunc),
+                                                       std::move(name),
+                                                       format,
+                                                       LineFormat(format)}))
+    {
+    }
+
+    EmbedLog::EmbedLog(OpenFunction openFunc,
+                       CloseFunction closeFunc,
+                       PrintFunction printFunc,
+                       MicrosecondFunction microsecondFunc,
+                       std::string name,
+                       LineFormat line)
+        : config(std::make_shared<const Config>(Config{std::move(openFunc),
+                                                       std::move(closeFunc),
+                                                       std::move(printFunc),
+                                                       std::move(microsecondFunc),
+                                                       std::move(name),
+                                                       line.getFormat(),
+                                                       std::move(line)}))
     {
     }
 
+    EmbedLog::EmbedLog(ConfigPointer config)
+        : config(std::move(config))
+    {
+        // Compile the format once here if the config was built by hand
+        if (!this->config->line.isValid())
+        {
+            Config compiled = *this->config;
+            compiled.line = LineFormat(compiled.format);
+            this->config = std::make_shared<const Config>(std::move(compiled));
+        }
+    }
+
     EmbedLog::~EmbedLog()
     {
+        // Print what is still deferred, so trace events are inside the closing bracket
+        flush();
+        finishTrace();
+
         if (isOpen)
-            closeFunc();
+            config->closeFunc();
+
+        delete throttleTable.load();
+        clearStages();
     }
 
     bool EmbedLog::open()
     {
         if (!isOpen)
-            isOpen = openFunc();
+        {
+            isOpen = config->openFunc();
+
+            if (isOpen && extensions && extensions->persistent)
+                startPersistentRegion();
+        }
         return isOpen;
     }
 
     bool EmbedLog::close()
     {
-        bool result = closeFunc();
+        flush();
+        finishTrace();
+        if (extensions && extensions->flashStore)
+            extensions->flashStore->sync();
+
+        bool result = config->closeFunc();
         isOpen = !result;
         return result;
     }
 
     void EmbedLog::log(LogLevel level, const std::string& format, ...)
     {
-        if (!isOpen)
+        if (!isEnabled(level) || !acceptSample())
             return;
 
-        if (level < logLevel)
+        va_list args;
+        va_start(args, format);
+        vlog(level, format, args, sampleRate);
+        va_end(args);
+    }
+
+    void EmbedLog::log_sampled(double rate, LogLevel level, const std::string& format, ...)
+    {
+        if (!isEnabled(level) || !accept_sample(rate))
             return;
 
         va_list args;
         va_start(args, format);
-        
-        // First pass to get the required buffer size
-        int size = vsnprintf(nullptr, 0, format.c_str(), args);
+        vlog(level, format, args, rate);
+        va_end(args);
+    }
+
+    void EmbedLog::log_throttled(size_t throttle_id, uint32_t throttle_ms, LogLevel level,  const std::string& format, ...)
+    {
+        if (!isEnabled(level) || !acceptThrottle(throttle_id, throttle_ms))
+            return;
+
+        va_list args;
+        va_start(args, format);
+        vlog(level, format, args);
         va_end(args);
+    }
+
+    void EmbedLog::log_every_n(CallSiteCounter& counter, uint32_t n, LogLevel level, const std::string& format, ...)
+    {
+        if (!isEnabled(level) || !accept_every_n(counter, n))
+            return;
+
+        va_list args;
+        va_start(args, format);
+        vlog(level, format, args);
+        va_end(args);
+    }
+
+    void EmbedLog::log_first_n(CallSiteCounter& counter, uint32_t n, LogLevel level, const std::string& format, ...)
+    {
+        if (!isEnabled(level) || !accept_first_n(counter, n))
+            return;
+
+        va_list args;
+        va_start(args, format);
+        vlog(level, format, args);
+        va_end(args);
+    }
+
+    void EmbedLog::log_once(CallSiteCounter& counter, LogLevel level, const std::string& format, ...)
+    {
+        if (!isEnabled(level) || !accept_first_n(counter, 1))
+            return;
+
+        va_list args;
+        va_start(args, format);
+        vlog(level, format, args);
+        va_end(args);
+    }
+
+    void EmbedLog::log_unchecked(LogLevel level, double rate, const std::string& format, ...)
+    {
+        va_list args;
+        va_start(args, format);
+        vlog(level, format, args, rate);
+        va_end(args);
+    }
+
+    bool EmbedLog::acceptSample()
+    {
+        bool accepted = sample_threshold_passes(sampleThreshold);
+        EMBDL_PROBE1(sample, accepted);
+        return accepted;
+    }
+
+    bool EmbedLog::acceptThrottle(size_t throttle_id, uint32_t throttle_ms)
+    {
+        ThrottleTable* table = throttleTable.load(std::memory_order_acquire);
+        if (!table)
+        {
+            // Threads racing to create the table keep whichever was installed first
+            ThrottleTable* created = new ThrottleTable(throttleCapacity, throttleCache);
+            if (throttleTable.compare_exchange_strong(table, created, std::memory_order_acq_rel))
+                table = created;
+            else
+                delete created;
+        }
+
+        bool accepted = table->acquire(throttle_id, static_cast<uint64_t>(throttle_ms) * 1000, getTimestamp());
+        EMBDL_PROBE2(throttle, throttle_id, accepted);
+        return accepted;
+    }
+
+    void EmbedLog::setThrottleCapacity(size_t capacity)
+    {
+        throttleCapacity = static_cast<uint32_t>(capacity);
+        delete throttleTable.exchange(nullptr);
+    }
+
+    void EmbedLog::setThrottleCacheEnabled(bool enabled)
+    {
+        throttleCache = enabled;
+        delete throttleTable.exchange(nullptr);
+    }
+
+    ThrottleStats EmbedLog::getThrottleStats() const
+    {
+        ThrottleTable* table = throttleTable.load(std::memory_order_acquire);
+        return table ? table->getStats() : ThrottleStats{};
+    }
+
+    void EmbedLog::expireThrottles()
+    {
+        ThrottleTable* table = throttleTable.load(std::memory_order_acquire);
+        if (table)
+            table->expire(getTimestamp());
+    }
+
+    void EmbedLog::vlog(LogLevel level, const std::string& format, va_list args, double rate)
+    {
+        EMBDL_PROBE1(format, static_cast<int>(level));
+
+        va_list sizeArgs;
+        va_copy(sizeArgs, args);
+
+        // First pass to get the required buffer size
+        int size = vsnprintf(nullptr, 0, format.c_str(), sizeArgs);
+        va_end(sizeArgs);
 
         if (size < 0)
             return; // Handle error in formatting
-        
+
         // Allocate a buffer of the required size
         std::vector<char> buffer(size + 1); // +1 for the null terminator
-        
-        va_start(args, format);
         vsnprintf(buffer.data(), buffer.size(), format.c_str(), args);
-        va_end(args);
 
-        print(level, buffer.data());
+        print(level, buffer.data(), getTimestamp(), rate);
     }
 
-    void EmbedLog::log_throttled(size_t throttle_id, uint32_t throttle_ms, LogLevel level,  const std::string& format, ...)
+    void EmbedLog::renderDeferred(const uint8_t* record, Rendered& out) const
     {
-        if (!isOpen)
+        DeferredRecord header;
+        std::memcpy(&header, record, sizeof(header));
+        const uint8_t* args = record + sizeof(header);
+
+        if (header.style == FORMAT_BATCH)
+        {
+            const uint8_t* end = args + header.size;
+            while (args < end)
+            {
+                DeferredRecord inner;
+                std::memcpy(&inner, args, sizeof(inner));
+                renderDeferred(args, out);
+                args += sizeof(inner) + inner.size;
+            }
             return;
+        }
 
-        if (level < logLevel)
+        if (header.style == FORMAT_TRACE)
+        {
+            ArgValue values[2];
+            decode_args(args, header.size, values, 2);
+            append_trace_event(out.text, static_cast<char>(header.level), static_cast<const char*>(header.format),
+                               header.timestamp, static_cast<uint32_t>(values[0].value.u), values[1].value.u);
+            out.lines.push_back({out.text.size(), header.timestamp, header.level, true});
             return;
+        }
 
-        auto now = microsecondFunc();
-        auto last = throttleMap[throttle_id];
-        if (now - last > throttle_ms * 1000)
+        // A sampled message carries its rate after its arguments
+        uint32_t size = header.size;
+        double rate = 1.0;
+        if (header.style & FORMAT_SAMPLED)
         {
-            va_list args;
-            va_start(args, format);
-            
-            // First pass to get the required buffer size
-            int size = vsnprintf(nullptr, 0, format.c_str(), args);
-            va_end(args);
+            size -= SAMPLE_RATE_SIZE;
+            std::memcpy(&rate, args + size + 1, sizeof(rate));
+        }
+        uint16_t style = header.style & ~FORMAT_SAMPLED;
+
+        std::string& message = out.message;
+        message.clear();
+        if (style == FORMAT_TEXT)
+            message.assign(reinterpret_cast<const char*>(args), size);
+        else if (style == FORMAT_BRACES)
+            render_braces(message, *static_cast<const BraceDescriptor*>(header.format), args, size);
+        else
+            render_format(message, static_cast<const char*>(header.format), args, size);
+        if (rate < 1.0)
+            append_sample_tag(message, rate);
+
+        LogLevel level = static_cast<LogLevel>(header.level);
+        config->line.render(out.text, LineFields{config->name, getLogLevelString(level), message, header.timestamp, &out.clock});
+        out.lines.push_back({out.text.size(), header.timestamp, header.level, false});
+    }
 
-            if (size < 0)
-                return; // Handle error in formatting
-            
-            // Allocate a buffer of the required size
-            std::vector<char> buffer(size + 1); // +1 for the null terminator
-            
-            va_start(args, format);
-            vsnprintf(buffer.data(), buffer.size(), format.c_str(), args);
-            va_end(args);
+    EmbedLog::Extensions& EmbedLog::getExtensions()
+    {
+        if (!extensions)
+            extensions = std::make_unique<Extensions>();
+        return *extensions;
+    }
 
-            print(level, buffer.data()); // Use buffer.data() for the pointer to the char array
-            throttleMap[throttle_id] = now;
+    void EmbedLog::writeExtensions(uint64_t timestamp, const char* text, size_t length)
+    {
+        if (extensions->flashStore)
+            extensions->flashStore->append(text, length);
+        for (const std::unique_ptr<SinkQueue>& sink : extensions->sinks)
+            sink->push(timestamp, text, length);
+    }
+
+    void EmbedLog::retainDeferred(const uint8_t* record, Rendered* traces)
+    {
+        DeferredRecord header;
+        std::memcpy(&header, record, sizeof(header));
+        const uint8_t* args = record + sizeof(header);
+
+        // Keep the messages of a batch one by one, so each is counted and dumped on its own
+        if (header.style == FORMAT_BATCH)
+        {
+            const uint8_t* end = args + header.size;
+            while (args < end)
+            {
+                DeferredRecord inner;
+                std::memcpy(&inner, args, sizeof(inner));
+                retainDeferred(args, traces);
+                args += sizeof(inner) + inner.size;
+            }
+            return;
         }
+
+        if (header.style == FORMAT_TRACE)
+        {
+            if (traces)
+                renderDeferred(record, *traces);
+            return;
+        }
+
+        extensions->recorder->append(header.timestamp, record, sizeof(header) + header.size);
     }
 
-    void EmbedLog::print(LogLevel level, const std::string& message)
+    void EmbedLog::printRendered(Rendered& rendered)
     {
-        uint64_t microseconds = microsecondFunc();
-        uint64_t totalSeconds = microseconds / 1000000;
-        uint64_t remainingMicroseconds = microseconds % 1000000;
+        size_t start = 0;
+        for (const Rendered::Line& line : rendered.lines)
+        {
+            const char* text = rendered.text.data() + start;
+            size_t length = line.end - start;
+            start = line.end;
 
-        uint64_t hours = totalSeconds / 3600;
-        uint64_t minutes = (totalSeconds % 3600) / 60;
-        uint64_t seconds = totalSeconds % 60;
+            if (line.trace)
+            {
+                writeTrace(text, length);
+                continue;
+            }
+
+            EMBDL_PROBE2(write, static_cast<int>(line.level), length);
+            rendered.message.assign(text, length);
+            if (extensions && extensions->persistent)
+                extensions->persistent->write(text, length);
+            config->printFunc(rendered.message);
+            if (extensions)
+                writeExtensions(line.timestamp, text, length);
+        }
+        rendered.clear();
+    }
+
+    void EmbedLog::setDeferredCapacity(size_t capacity)
+    {
+        clearStages();
+        if (capacity)
+            getExtensions();
+        records.reset(capacity ? new RecordRing(capacity) : nullptr);
+    }
+
+    size_t EmbedLog::addSink(PrintFunction sink, size_t capacity, SinkPolicy policy, bool ownThread)
+    {
+        std::vector<std::unique_ptr<SinkQueue>>& sinks = getExtensions().sinks;
+        sinks.push_back(std::make_unique<SinkQueue>(std::move(sink), capacity, policy, ownThread));
+        return sinks.size() - 1;
+    }
+
+    size_t EmbedLog::deliverSink(size_t sink, size_t limit)
+    {
+        return extensions && sink < extensions->sinks.size() ? extensions->sinks[sink]->deliver(limit) : 0;
+    }
+
+    SinkStats EmbedLog::getSinkStats(size_t sink) const
+    {
+        return extensions && sink < extensions->sinks.size() ? extensions->sinks[sink]->getStats() : SinkStats{};
+    }
+
+    void EmbedLog::setPersistentRegion(void* region, size_t size)
+    {
+        std::unique_ptr<PersistentRegion>& persistent = getExtensions().persistent;
+        persistent.reset(region ? new PersistentRegion(region, size) : nullptr);
+        extensions->persistentStarted = false;
+        if (isOpen && persistent)
+            startPersistentRegion();
+    }
 
-        std::stringstream result;
-        for (size_t i = 0; i < format.size(); ++i)
+    void EmbedLog::startPersistentRegion()
+    {
+        // Only once per region, so reopening the log keeps this boot's lines and appends to them
+        if (extensions->persistentStarted)
+            return;
+        extensions->persistentStarted = true;
+
+        // Print what the previous boot left behind, then start on this boot's lines
+        extensions->recoveredLines = extensions->persistent->recover(config->printFunc);
+        extensions->persistent->reset();
+    }
+
+    size_t EmbedLog::getRecoveredLines() const
+    {
+        return extensions ? extensions->recoveredLines : 0;
+    }
+
+    bool EmbedLog::setFlashStore(BlockDevice* device)
+    {
+        std::unique_ptr<FlashStore>& flashStore = getExtensions().flashStore;
+        flashStore.reset(device ? new FlashStore(*device) : nullptr);
+        if (flashStore && !flashStore->mount())
         {
-            if (format[i] == '%')
+            flashStore.reset();
+            return false;
+        }
+        return true;
+    }
+
+    FlashStore* EmbedLog::getFlashStore()
+    {
+        return extensions ? extensions->flashStore.get() : nullptr;
+    }
+
+    void EmbedLog::setFlightRecorder(size_t budget, bool printLines)
+    {
+        Extensions& extension = getExtensions();
+        extension.recorder.reset(budget ? new FlightRecorder(budget) : nullptr);
+        extension.recorderPrints = printLines || !budget;
+    }
+
+    size_t EmbedLog::dumpFlightRecorder(PrintFunction out)
+    {
+        flush();
+        if (!extensions || !extensions->recorder)
+            return 0;
+
+        Rendered rendered;
+        size_t count = 0;
+        extensions->recorder->replay([&](const uint8_t* record, size_t) {
+            renderDeferred(record, rendered);
+
+            size_t start = 0;
+            for (const Rendered::Line& line : rendered.lines)
             {
-                ++i; // Skip the '%' and check the next character
-                switch (format[i])
+                if (!line.trace)
                 {
-                case 'N':
-                    result << name; // Name
-                    break;
-                case 'L':
-                    result << getLogLevelString(level); // Level
-                    break;
-                case 'T':
-                    result << message; // Text
-                    break;
-                case 'D':
-                    result << std::setfill('0') << std::setw(2) << (hours / 24); // Days
-                    break;
-                case 'H':
-                    result << std::setfill('0') << std::setw(2) << (hours % 24); // Hours
-                    break;
-                case 'M':
-                    result << std::setfill('0') << std::setw(2) << minutes; // Minutes
-                    break;
-                case 'S':
-                    result << std::setfill('0') << std::setw(2) << seconds; // Seconds
-                    break;
-                case 'U':
-                    result << std::setfill('0') << std::setw(6) << remainingMicroseconds; // Microseconds
-                    break;
-                default:
-                    result << '%' << format[i]; // Unknown
-                    break;
+                    rendered.message.assign(rendered.text, start, line.end - start);
+                    out(rendered.message);
+                    ++count;
                 }
+                start = line.end;
             }
-            else
+            rendered.clear();
+        });
+        return count;
+    }
+
+    FlightRecorderStats EmbedLog::getFlightRecorderStats() const
+    {
+        return extensions && extensions->recorder ? extensions->recorder->getStats() : FlightRecorderStats{};
+    }
+
+    void EmbedLog::setRenderThreads(size_t threads)
+    {
+        std::unique_ptr<FlushState>& flushState = getExtensions().flushState;
+        if (!flushState)
+            flushState = std::make_unique<FlushState>();
+
+        flushState->workers.resize(threads > 1 ? threads : 1);
+        flushState->pool.reset(threads > 1 ? new RenderPool(threads) : nullptr);
+    }
+
+    void EmbedLog::setThreadBatching(size_t capacity)
+    {
+        clearStages();
+        if (capacity)
+            getExtensions();
+        stageCapacity = static_cast<uint32_t>(capacity);
+    }
+
+    EmbedLog::ThreadStage* EmbedLog::acquireStage(size_t size)
+    {
+        // Most calls find the stage in the cache; otherwise look for it, or add one
+        ThreadStageCache& cache = threadStageCache;
+        Extensions& extension = *extensions;
+        ThreadStage* stage = cache.generation == extension.stageGeneration ? static_cast<ThreadStage*>(cache.stage) : nullptr;
+        if (!stage)
+        {
+            const void* thread = &cache;
+            std::atomic<ThreadStage*>& stages = extension.stages;
+            for (stage = stages.load(std::memory_order_acquire); stage && stage->thread.load(std::memory_order_relaxed) != thread; stage = stage->next)
+            {
+            }
+
+            if (!stage)
             {
-                result << format[i]; // Normal character
+                // Take over a stage left by a thread that has exited, or add one
+                for (stage = stages.load(std::memory_order_acquire); stage; stage = stage->next)
+                {
+                    const void* none = nullptr;
+                    if (stage->thread.compare_exchange_strong(none, thread, std::memory_order_acquire, std::memory_order_relaxed))
+                        break;
+                }
+
+                if (!stage)
+                {
+                    stage = new ThreadStage(thread, stageCapacity);
+                    ThreadStage* head = stages.load(std::memory_order_relaxed);
+                    do
+                        stage->next = head;
+                    while (!stages.compare_exchange_weak(head, stage, std::memory_order_release, std::memory_order_relaxed));
+                }
+                ownStage(stage);
             }
+
+            cache.generation = extension.stageGeneration;
+            cache.stage = stage;
+        }
+
+        uint8_t holder = STAGE_FREE;
+        while (!stage->state.compare_exchange_weak(holder, STAGE_WRITING, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+#if !defined(EMBEDLOG_NO_THREADS)
+            // Flush publishes the stage quickly; wait, so this message stays behind the ones it holds
+            if (holder == STAGE_SWEEPING)
+            {
+                std::this_thread::yield();
+                holder = STAGE_FREE;
+                continue;
+            }
+#endif
+            // Interrupting this thread's own logging, or flush without threads to wait on
+            if (holder != STAGE_FREE)
+                return nullptr;
+        }
+
+        // A stage taken over from an exited thread needs its buffer back
+        if (!stage->data)
+            stage->data.reset(new uint8_t[stageCapacity]);
+
+        // Publish what the stage holds first when the message will not fit, even if it
+        // then goes to the ring on its own, so the thread's messages stay in order
+        if (stage->size + size > stageCapacity)
+            publishStage(stage);
+        return stage;
+    }
+
+    uint8_t* EmbedLog::stageEnd(ThreadStage* stage)
+    {
+        return stage->data.get() + stage->size;
+    }
+
+    void EmbedLog::releaseStage(ThreadStage* stage, size_t size, bool publish)
+    {
+        stage->size += size;
+        stage->count += size != 0;
+        if (publish)
+            publishStage(stage);
+        stage->state.store(STAGE_FREE, std::memory_order_release);
+    }
+
+    void EmbedLog::publishThreadStage()
+    {
+        ThreadStage* stage = stageCapacity && records ? acquireStage(0) : nullptr;
+        if (stage)
+            releaseStage(stage, 0, true);
+    }
+
+    void EmbedLog::publishStage(ThreadStage* stage)
+    {
+        if (stage->size == 0)
+            return;
+
+        uint8_t* out = records->reserve(sizeof(DeferredRecord) + stage->size);
+        if (out)
+        {
+            DeferredRecord header{0, nullptr, static_cast<uint32_t>(stage->size), 0, FORMAT_BATCH};
+            std::memcpy(out, &header, sizeof(header));
+            std::memcpy(out + sizeof(header), stage->data.get(), stage->size);
+            records->commit(out);
+        }
+        else
+        {
+            // The ring counted the stage as one record; count every message it held
+            records->addDropped(stage->count - 1);
+            EMBDL_PROBE1(drop, stage->size);
+        }
+        stage->size = 0;
+        stage->count = 0;
+    }
+
+    void EmbedLog::retireStage(ThreadStage* stage)
+    {
+#if !defined(EMBEDLOG_NO_THREADS)
+        // Only flush can hold the stage now, and it lets go quickly
+        uint8_t holder = STAGE_FREE;
+        while (!stage->state.compare_exchange_weak(holder, STAGE_WRITING, std::memory_order_acquire, std::memory_order_relaxed))
+        {
+            std::this_thread::yield();
+            holder = STAGE_FREE;
+        }
+
+        publishStage(stage);
+        stage->data.reset();
+        stage->state.store(STAGE_FREE, std::memory_order_release);
+        stage->thread.store(nullptr, std::memory_order_release);
+#else
+        (void)stage;
+#endif
+    }
+
+    void EmbedLog::ownStage(ThreadStage* stage)
+    {
+#if !defined(EMBEDLOG_NO_THREADS)
+        StageRegistry& registry = stage_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        uint64_t generation = extensions->stageGeneration;
+        if (!is_live(registry, generation))
+            registry.live.push_back(generation);
+
+        // Forget stages of logs that have since been destroyed or cleared
+        std::vector<ThreadStageOwner::Owned>& owned = ThreadStageOwner::current().stages;
+        owned.erase(std::remove_if(owned.begin(), owned.end(), [&](const ThreadStageOwner::Owned& entry) {
+            return !is_live(registry, entry.generation);
+        }), owned.end());
+        owned.push_back(ThreadStageOwner::Owned{this, generation, stage});
+#else
+        (void)stage;
+#endif
+    }
+
+    void EmbedLog::clearStages()
+    {
+        if (!extensions)
+            return;
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        // Held while deleting, so a thread exiting now cannot retire a stage being deleted
+        StageRegistry& registry = stage_registry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.live.erase(std::remove(registry.live.begin(), registry.live.end(), extensions->stageGeneration), registry.live.end());
+#endif
+
+        ThreadStage* stage = extensions->stages.exchange(nullptr);
+        while (stage)
+        {
+            ThreadStage* next = stage->next;
+            delete stage;
+            stage = next;
+        }
+
+        // A new generation stops threads using stages cached before they were deleted
+        extensions->stageGeneration = nextStageGeneration.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void EmbedLog::setCoarseClock(bool enabled)
+    {
+        updateClock();
+        coarseClock = enabled;
+    }
+
+    void EmbedLog::updateClock()
+    {
+        coarseTime.store(config->microsecondFunc(), std::memory_order_relaxed);
+    }
+
+    size_t EmbedLog::flush()
+    {
+        if (coarseClock)
+            updateClock();
+
+        if (!records)
+            return 0;
+
+        // Sweep up messages gathered by threads, skipping any stage in use
+        Extensions& extension = *extensions;
+        for (ThreadStage* stage = extension.stages.load(std::memory_order_acquire); stage; stage = stage->next)
+        {
+            uint8_t holder = STAGE_FREE;
+            if (!stage->state.compare_exchange_strong(holder, STAGE_SWEEPING, std::memory_order_acquire))
+                continue;
+            publishStage(stage);
+            stage->state.store(STAGE_FREE, std::memory_order_release);
+        }
+
+        if (!extension.flushState)
+            extension.flushState = std::make_unique<FlushState>();
+        FlushState& state = *extension.flushState;
+        bool recording = extension.recorder != nullptr;
+        bool recorderPrints = extension.recorderPrints;
+
+        if (!state.pool || !recorderPrints)
+        {
+            Rendered& out = state.workers[0];
+            return records->drain([&](const uint8_t* record, size_t) {
+                if (recording)
+                    retainDeferred(record, recorderPrints ? nullptr : &out);
+                if (recorderPrints)
+                    renderDeferred(record, out);
+                printRendered(out);
+            });
+        }
+
+        // Copy out a chunk of records, format slices of it on every thread, then print in order
+        size_t total = 0;
+        size_t threads = state.workers.size();
+        for (;;)
+        {
+            state.records.clear();
+            state.offsets.clear();
+            size_t count = records->drain([&](const uint8_t* record, size_t size) {
+                size_t offset = (state.records.size() + 7) & ~size_t(7);
+                state.offsets.push_back(offset);
+                state.records.resize(offset + size);
+                std::memcpy(state.records.data() + offset, record, size);
+                if (recording)
+                    retainDeferred(record, nullptr);
+            }, FLUSH_CHUNK);
+
+            if (count == 0)
+                break;
+            total += count;
+
+            state.pool->run(threads, [&](size_t worker) {
+                for (size_t i = count * worker / threads; i < count * (worker + 1) / threads; ++i)
+                    renderDeferred(state.records.data() + state.offsets[i], state.workers[worker]);
+            });
+
+            for (Rendered& out : state.workers)
+                printRendered(out);
+
+            if (count < FLUSH_CHUNK)
+                break;
+        }
+        return total;
+    }
+
+    uint64_t EmbedLog::getDroppedMessages() const
+    {
+        return records ? records->getDropped() : 0;
+    }
+
+    void EmbedLog::print(LogLevel level, const std::string& message, uint64_t microseconds, double rate)
+    {
+        // Messages printed straight away carry on from the thread's previous timestamp
+        thread_local LineClock clock;
+
+        // Each thread reuses its line buffer, unless a print function logs from inside print
+        thread_local std::string threadLine;
+        thread_local bool threadLineBusy = false;
+        std::string nested;
+        bool owner = !threadLineBusy;
+        std::string& line = owner ? threadLine : nested;
+        threadLineBusy = true;
+
+        // Sampled messages are tagged in a scratch copy, which is done with before printing
+        const std::string* text = &message;
+        if (rate < 1.0)
+        {
+            thread_local std::string tagged;
+            tagged.assign(message);
+            append_sample_tag(tagged, rate);
+            text = &tagged;
         }
-        result << "\n";
 
-        printFunc(result.str());
+        line.clear();
+        config->line.render(line, LineFields{config->name, getLogLevelString(level), *text, microseconds, &clock});
+        EMBDL_PROBE2(write, static_cast<int>(level), line.size());
+
+        // Kept before printing, so a print that never returns, and trips the watchdog, leaves its line
+        if (extensions && extensions->persistent)
+            extensions->persistent->write(line.data(), line.size());
+        config->printFunc(line);
+        if (extensions)
+            writeExtensions(microseconds, line.data(), line.size());
+
+        if (owner)
+            threadLineBusy = false;
+    }
+
+    RecordBuilder EmbedLog::begin(LogLevel level, size_t capacity)
+    {
+        return RecordBuilder(isEnabled(level) ? this : nullptr, level, capacity);
+    }
+
+    LogBatch EmbedLog::batch(LogLevel level, size_t capacity)
+    {
+        return LogBatch(isEnabled(level) ? this : nullptr, level, capacity);
+    }
+
+    ScopedTimer EmbedLog::scopedTimer(LogLevel level, const char* name, uint64_t threshold)
+    {
+        return ScopedTimer(isEnabled(level) ? this : nullptr, level, name, threshold);
+    }
+
+    ScopedTimer::ScopedTimer(EmbedLog* log, LogLevel level, const char* name, uint64_t threshold)
+        : log(log), name(name), start(log ? log->getConfig()->microsecondFunc() : 0), threshold(threshold), level(level)
+    {
+    }
+
+    ScopedTimer::ScopedTimer(ScopedTimer&& other) noexcept
+        : log(other.log), name(other.name), start(other.start), threshold(other.threshold), level(other.level)
+    {
+        other.log = nullptr;
+    }
+
+    ScopedTimer::~ScopedTimer()
+    {
+        if (!log)
+            return;
+
+        // Check the threshold before doing any formatting
+        uint64_t elapsed = log->getConfig()->microsecondFunc() - start;
+        if (elapsed < threshold)
+            return;
+
+        log->log_deferred(level, "%s took %llu us", name, static_cast<unsigned long long>(elapsed));
+    }
+
+    void EmbedLog::setTraceFunction(PrintFunction traceFunc)
+    {
+        finishTrace();
+
+        Extensions& extension = getExtensions();
+        EMBDL_TRACE_LOCK(extension.traceMutex);
+        tracing = static_cast<bool>(traceFunc);
+        extension.traceFunc = std::move(traceFunc);
+    }
+
+    void EmbedLog::traceBegin(const char* name)
+    {
+        if (isTracing())
+            traceEvent(TRACE_BEGIN, name, config->microsecondFunc(), 0);
+    }
+
+    void EmbedLog::traceEnd(const char* name)
+    {
+        if (isTracing())
+            traceEvent(TRACE_END, name, config->microsecondFunc(), 0);
+    }
+
+    void EmbedLog::traceInstant(const char* name)
+    {
+        if (isTracing())
+            traceEvent(TRACE_INSTANT, name, config->microsecondFunc(), 0);
+    }
+
+    TraceSpan EmbedLog::traceSpan(const char* name)
+    {
+        return TraceSpan(isTracing() ? this : nullptr, name);
+    }
+
+    void EmbedLog::traceEvent(char phase, const char* name, uint64_t timestamp, uint64_t duration)
+    {
+        uint32_t thread = trace_thread_id();
+        if (!records)
+        {
+            printTrace(phase, name, timestamp, thread, duration);
+            return;
+        }
+
+        capture(DeferredRecord{timestamp, name, 0, static_cast<uint16_t>(phase), FORMAT_TRACE}, thread, duration);
+    }
+
+    void EmbedLog::printTrace(char phase, const char* name, uint64_t timestamp, uint32_t thread, uint64_t duration)
+    {
+        std::string event;
+        append_trace_event(event, phase, name, timestamp, thread, duration);
+        writeTrace(event.data(), event.size());
+    }
+
+    void EmbedLog::writeTrace(const char* event, size_t length)
+    {
+        // Held while writing, so events from several threads are separated properly and stay whole
+        if (!extensions)
+            return;
+
+        Extensions& extension = *extensions;
+        EMBDL_TRACE_LOCK(extension.traceMutex);
+        if (!extension.traceFunc)
+            return;
+
+        // Events are separated by commas, so the trace is valid JSON once closed
+        std::string text(extension.traceStarted ? ",\n" : "[\n");
+        text.append(event, length);
+        extension.traceStarted = true;
+
+        extension.traceFunc(text);
+    }
+
+    void EmbedLog::finishTrace()
+    {
+        if (!extensions)
+            return;
+
+        Extensions& extension = *extensions;
+        EMBDL_TRACE_LOCK(extension.traceMutex);
+        if (!extension.traceStarted)
+            return;
+
+        extension.traceStarted = false;
+        extension.traceFunc("\n]\n");
+    }
+
+    TraceSpan::TraceSpan(EmbedLog* log, const char* name)
+        : log(log), name(name), start(log ? log->getConfig()->microsecondFunc() : 0)
+    {
+    }
+
+    TraceSpan::TraceSpan(TraceSpan&& other) noexcept
+        : log(other.log), name(other.name), start(other.start)
+    {
+        other.log = nullptr;
+    }
+
+    TraceSpan::~TraceSpan()
+    {
+        if (log)
+            log->traceEvent(TRACE_COMPLETE, name, start, log->getConfig()->microsecondFunc() - start);
+    }
+
+    const ConfigPointer& EmbedLog::getConfig() const
+    {
+        return config;
     }
 
     void EmbedLog::setLogLevel(LogLevel level)
@@ -196,7 +1161,18 @@ namespace EmbedLog
         logLevel = level;
     }
 
-    std::string EmbedLog::getLogLevelString(LogLevel level)
+    double EmbedLog::getSampleRate() const
+    {
+        return sampleRate;
+    }
+
+    void EmbedLog::setSampleRate(double rate)
+    {
+        sampleThreshold = sample_threshold(rate);
+        sampleRate = rate < 1.0 ? (rate > 0.0 ? rate : 0.0) : 1.0;
+    }
+
+    const char* EmbedLog::getLogLevelString(LogLevel level)
     {
         switch (level)
         {
@@ -0,0 +1,137 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * FileBlockDevice simulates a BlockDevice in a file, for testing FlashStore
+ * on a host. It is only built with EMBEDLOG_FILE_BLOCK_DEVICE.
+ *
+ */
+
+#include "EmbedLog/FileBlockDevice.hpp"
+
+#include <memory>
+
+namespace EmbedLog
+{
+    FileBlockDevice::FileBlockDevice(const char* path, size_t blockSize, size_t blockCount, size_t programSize)
+        : blockSize(blockSize), blockCount(blockCount), programSize(programSize ? programSize : 1), erases(blockCount)
+    {
+        file = std::fopen(path, "r+b");
+        if (file)
+        {
+            std::fseek(file, 0, SEEK_END);
+            if (static_cast<size_t>(std::ftell(file)) != blockSize * blockCount)
+            {
+                std::fclose(file);
+                file = nullptr;
+            }
+        }
+
+        // A new device starts erased
+        if (!file)
+        {
+            file = std::fopen(path, "w+b");
+            for (size_t block = 0; file && block < blockCount; ++block)
+                erase(block);
+            erases.assign(blockCount, 0);
+        }
+    }
+
+    FileBlockDevice::~FileBlockDevice()
+    {
+        if (file)
+            std::fclose(file);
+    }
+
+    bool FileBlockDevice::isOpen() const
+    {
+        return file != nullptr;
+    }
+
+    size_t FileBlockDevice::getBlockSize() const
+    {
+        return blockSize;
+    }
+
+    size_t FileBlockDevice::getBlockCount() const
+    {
+        return blockCount;
+    }
+
+    size_t FileBlockDevice::getProgramSize() const
+    {
+        return programSize;
+    }
+
+    bool FileBlockDevice::inRange(size_t block, size_t offset, size_t size) const
+    {
+        return file && block < blockCount && offset <= blockSize && size <= blockSize - offset;
+    }
+
+    bool FileBlockDevice::read(size_t block, size_t offset, void* data, size_t size)
+    {
+        if (!inRange(block, offset, size))
+            return false;
+
+        std::fseek(file, static_cast<long>(block * blockSize + offset), SEEK_SET);
+        return std::fread(data, 1, size, file) == size;
+    }
+
+    bool FileBlockDevice::program(size_t block, size_t offset, const void* data, size_t size)
+    {
+        if (!inRange(block, offset, size) || offset % programSize != 0 || size % programSize != 0)
+            return false;
+
+        // Programming can only clear bits
+        std::unique_ptr<uint8_t[]> bytes(new uint8_t[size]);
+        if (!read(block, offset, bytes.get(), size))
+            return false;
+        const uint8_t* in = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i)
+            bytes[i] &= in[i];
+
+        std::fseek(file, static_cast<long>(block * blockSize + offset), SEEK_SET);
+        programs += size / programSize;
+        return std::fwrite(bytes.get(), 1, size, file) == size && std::fflush(file) == 0;
+    }
+
+    bool FileBlockDevice::erase(size_t block)
+    {
+        if (!inRange(block, 0, blockSize))
+            return false;
+
+        std::vector<uint8_t> erased(blockSize, 0xFF);
+        std::fseek(file, static_cast<long>(block * blockSize), SEEK_SET);
+        ++erases[block];
+        return std::fwrite(erased.data(), 1, blockSize, file) == blockSize && std::fflush(file) == 0;
+    }
+
+    uint32_t FileBlockDevice::getEraseCount(size_t block) const
+    {
+        return block < blockCount ? erases[block] : 0;
+    }
+
+    uint64_t FileBlockDevice::getProgramCount() const
+    {
+        return programs;
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,336 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * FlashStore appends lines to raw flash as a log of erase block sized
+ * segments, without a filesystem, reusing blocks in turn so they wear
+ * evenly.
+ *
+ */
+
+
+#include "EmbedLog/FlashStore.hpp"
+#include "EmbedLog/Hash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#if defined(EMBEDLOG_NO_THREADS)
+#define EMBDL_STORE_LOCK(m)
+#else
+#define EMBDL_STORE_LOCK(m) std::lock_guard<std::mutex> embdl_lock(m)
+#endif
+
+// A segment is its header, padded to a whole program unit, then lines packed one after
+// another, each a uint16_t length and uint16_t check followed by its text. Lines may cross
+// pages. A length of 0xFFFF is erased flash: at the start of a page it ends the segment,
+// otherwise it is the unused end of a page programmed by sync, and the next page carries on.
+
+namespace EmbedLog
+{
+    namespace
+    {
+        constexpr uint32_t SEGMENT_MAGIC = 0x454D4253; // "EMBS"
+        constexpr uint16_t ERASED_LENGTH = 0xFFFF;
+
+        struct LineHeader
+        {
+            uint16_t length;  // Length of the text.
+            uint16_t check;   // Hash of the text and its position.
+        };
+
+        size_t align(size_t size, size_t alignment)
+        {
+            return (size + alignment - 1) / alignment * alignment;
+        }
+    }
+
+    FlashStore::FlashStore(BlockDevice& device)
+        : device(device)
+    {
+    }
+
+    FlashStore::~FlashStore()
+    {
+        sync();
+    }
+
+    uint32_t FlashStore::headerCheck(const SegmentHeader& header)
+    {
+        uint64_t hash = hash_mix(hash_mix(hash_mix(HASH_SEED, header.magic), header.sequence), header.eraseCount);
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    uint16_t FlashStore::lineCheck(const char* text, size_t length, uint32_t sequence, size_t offset)
+    {
+        uint64_t hash = hash_bytes(text, length, hash_mix(hash_mix(HASH_SEED, sequence), offset));
+        hash ^= hash >> 32;
+        return static_cast<uint16_t>(hash ^ (hash >> 16));
+    }
+
+    bool FlashStore::mount()
+    {
+        EMBDL_STORE_LOCK(mutex);
+        mounted = false;
+        hasActive = false;
+        buffered = 0;
+
+        blockSize = device.getBlockSize();
+        pageSize = device.getProgramSize();
+        size_t count = device.getBlockCount();
+        if (count == 0 || pageSize == 0 || blockSize % pageSize != 0 ||
+            align(sizeof(SegmentHeader), pageSize) + pageSize > blockSize)
+            return false;
+
+        // Only the segment headers are read to find the newest segment
+        segments.assign(count, Segment{});
+        for (size_t block = 0; block < count; ++block)
+        {
+            SegmentHeader header;
+            if (!device.read(block, 0, &header, sizeof(header)) || header.magic != SEGMENT_MAGIC ||
+                header.check != headerCheck(header))
+                continue;
+
+            segments[block] = Segment{header.sequence, header.eraseCount, true};
+            if (!hasActive || header.sequence > sequence)
+            {
+                active = block;
+                sequence = header.sequence;
+                hasActive = true;
+            }
+        }
+
+        page.reset(new uint8_t[align(sizeof(SegmentHeader), pageSize)]);
+        if (hasActive)
+            offset = findEnd();
+
+        mounted = true;
+        return true;
+    }
+
+    size_t FlashStore::findEnd()
+    {
+        // Pages are programmed in order, so search for the first one still erased
+        size_t low = align(sizeof(SegmentHeader), pageSize) / pageSize;
+        size_t high = blockSize / pageSize;
+        while (low < high)
+        {
+            size_t middle = low + (high - low) / 2;
+            bool erased = device.read(active, middle * pageSize, page.get(), pageSize) &&
+                          std::all_of(page.get(), page.get() + pageSize, [](uint8_t byte) { return byte == 0xFF; });
+            if (erased)
+                high = middle;
+            else
+                low = middle + 1;
+        }
+        return low * pageSize;
+    }
+
+    bool FlashStore::openSegment()
+    {
+        // Take the blocks in turn, so each is erased once per lap of the device; a block
+        // that fails to erase or program is passed over
+        size_t count = segments.size();
+        size_t start = hasActive ? active + 1 : 0;
+        for (size_t attempt = 0; attempt < count; ++attempt)
+        {
+            size_t block = (start + attempt) % count;
+            Segment& segment = segments[block];
+            segment.valid = false;
+            ++segment.eraseCount;
+            ++erases;
+            if (!device.erase(block))
+                continue;
+
+            SegmentHeader header{SEGMENT_MAGIC, hasActive ? sequence + 1 : 1, segment.eraseCount, 0};
+            header.check = headerCheck(header);
+
+            size_t size = align(sizeof(SegmentHeader), pageSize);
+            std::memset(page.get(), 0xFF, size);
+            std::memcpy(page.get(), &header, sizeof(header));
+            ++pageWrites;
+            if (!device.program(block, 0, page.get(), size))
+            {
+                ++failedWrites;
+                continue;
+            }
+
+            segment = Segment{header.sequence, header.eraseCount, true};
+            active = block;
+            sequence = header.sequence;
+            offset = size;
+            buffered = 0;
+            hasActive = true;
+            return true;
+        }
+        return false;
+    }
+
+    bool FlashStore::programPage()
+    {
+        std::memset(page.get() + buffered, 0xFF, pageSize - buffered);
+        bool result = device.program(active, offset, page.get(), pageSize);
+        offset += pageSize;
+        buffered = 0;
+        ++pageWrites;
+        failedWrites += !result;
+        return result;
+    }
+
+    bool FlashStore::write(const void* data, size_t size)
+    {
+        const uint8_t* in = static_cast<const uint8_t*>(data);
+        while (size > 0)
+        {
+            size_t part = std::min(size, pageSize - buffered);
+            std::memcpy(page.get() + buffered, in, part);
+            buffered += part;
+            in += part;
+            size -= part;
+            if (buffered == pageSize && !programPage())
+                return false;
+        }
+        return true;
+    }
+
+    bool FlashStore::append(const char* text, size_t length)
+    {
+        EMBDL_STORE_LOCK(mutex);
+        if (!mounted)
+            return false;
+
+        size_t limit = blockSize - align(sizeof(SegmentHeader), pageSize) - sizeof(LineHeader);
+        length = std::min(length, std::min(limit, static_cast<size_t>(ERASED_LENGTH - 1)));
+
+        // Lines never cross into the next segment; a failure closing the old one is still reported
+        bool closed = true;
+        if (!hasActive || offset + buffered + sizeof(LineHeader) + length > blockSize)
+        {
+            if (hasActive && buffered != 0)
+                closed = programPage();
+            if (!openSegment())
+                return false;
+        }
+
+        LineHeader header{static_cast<uint16_t>(length), lineCheck(text, length, sequence, offset + buffered)};
+        ++lines;
+        return write(&header, sizeof(header)) && write(text, length) && closed;
+    }
+
+    bool FlashStore::sync()
+    {
+        EMBDL_STORE_LOCK(mutex);
+        return !mounted || buffered == 0 || programPage();
+    }
+
+    size_t FlashStore::readSegment(size_t block, uint32_t segmentSequence, const LineFunction& consume, std::string& line)
+    {
+        size_t count = 0;
+        size_t position = align(sizeof(SegmentHeader), pageSize);
+        while (position + sizeof(LineHeader) <= blockSize)
+        {
+            LineHeader header;
+            if (!device.read(block, position, &header, sizeof(header)))
+                break;
+
+            size_t nextPage = align(position + 1, pageSize);
+            if (header.length == ERASED_LENGTH)
+            {
+                if (position % pageSize == 0)
+                    break;
+                position = nextPage;
+                continue;
+            }
+
+            // A line that fails its check was torn by a reset; carry on from the next page
+            if (header.length > blockSize - position - sizeof(header))
+            {
+                position = nextPage;
+                continue;
+            }
+            line.resize(header.length);
+            if (!device.read(block, position + sizeof(header), &line[0], header.length) ||
+                header.check != lineCheck(line.data(), header.length, segmentSequence, position))
+            {
+                position = nextPage;
+                continue;
+            }
+
+            consume(line);
+            position += sizeof(header) + header.length;
+            ++count;
+        }
+        return count;
+    }
+
+    size_t FlashStore::read(const LineFunction& consume)
+    {
+        EMBDL_STORE_LOCK(mutex);
+        std::vector<std::pair<uint32_t, size_t>> order;
+        for (size_t block = 0; block < segments.size(); ++block)
+            if (segments[block].valid)
+                order.emplace_back(segments[block].sequence, block);
+        std::sort(order.begin(), order.end());
+
+        std::string line;
+        size_t count = 0;
+        for (const auto& segment : order)
+            count += readSegment(segment.second, segment.first, consume, line);
+        return count;
+    }
+
+    bool FlashStore::format()
+    {
+        EMBDL_STORE_LOCK(mutex);
+        bool result = true;
+        for (size_t block = 0; block < segments.size(); ++block)
+        {
+            segments[block].valid = false;
+            ++segments[block].eraseCount;
+            ++erases;
+            result = device.erase(block) && result;
+        }
+        hasActive = false;
+        buffered = 0;
+        return result;
+    }
+
+    FlashStoreStats FlashStore::getStats() const
+    {
+        EMBDL_STORE_LOCK(mutex);
+        FlashStoreStats stats;
+        stats.activeBlock = active;
+        stats.lines = lines;
+        stats.pageWrites = pageWrites;
+        stats.failedWrites = failedWrites;
+        stats.erases = erases;
+        for (size_t block = 0; block < segments.size(); ++block)
+        {
+            const Segment& segment = segments[block];
+            stats.segments += segment.valid;
+            stats.minEraseCount = block == 0 ? segment.eraseCount : std::min(stats.minEraseCount, segment.eraseCount);
+            stats.maxEraseCount = std::max(stats.maxEraseCount, segment.eraseCount);
+        }
+        return stats;
+    }
+
+} // namespace EmbedLog
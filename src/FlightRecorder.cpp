@@ -0,0 +1,290 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * FlightRecorder keeps a history of deferred messages in RAM, compressing
+ * older ones in blocks so a small budget covers a long stretch of time.
+ * Messages are only decompressed and formatted when the history is dumped.
+ *
+ */
+
+
+#include "EmbedLog/FlightRecorder.hpp"
+#include "EmbedLog/Compress.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace EmbedLog
+{
+    // Within a block each record is a uint32_t size followed by its bytes, then zeros up to
+    // the next multiple of 8, which keep the record aligned and compress away to almost nothing.
+    // A record's first 8 bytes, its timestamp, are stored as the difference from the record
+    // before, so the small steps between messages compress well too.
+
+    namespace
+    {
+        constexpr size_t ALIGNMENT = 16;
+        constexpr size_t RECORD_ALIGNMENT = 8;
+
+        size_t align(size_t size, size_t alignment = ALIGNMENT)
+        {
+            return (size + alignment - 1) & ~(alignment - 1);
+        }
+
+        // Replaces each record's first 8 bytes with the difference from the record before
+        void delta_encode(uint8_t* data, size_t size)
+        {
+            uint64_t previous = 0;
+            for (size_t offset = 0; offset + RECORD_ALIGNMENT <= size;)
+            {
+                uint32_t length;
+                std::memcpy(&length, data + offset, sizeof(length));
+                uint8_t* record = data + offset + RECORD_ALIGNMENT;
+                if (length >= sizeof(uint64_t))
+                {
+                    uint64_t value;
+                    std::memcpy(&value, record, sizeof(value));
+                    uint64_t delta = value - previous;
+                    std::memcpy(record, &delta, sizeof(delta));
+                    previous = value;
+                }
+                offset += align(RECORD_ALIGNMENT + length, RECORD_ALIGNMENT);
+            }
+        }
+
+        void delta_decode(uint8_t* data, size_t size)
+        {
+            uint64_t previous = 0;
+            for (size_t offset = 0; offset + RECORD_ALIGNMENT <= size;)
+            {
+                uint32_t length;
+                std::memcpy(&length, data + offset, sizeof(length));
+                if (offset + RECORD_ALIGNMENT + length > size)
+                    break;
+                uint8_t* record = data + offset + RECORD_ALIGNMENT;
+                if (length >= sizeof(uint64_t))
+                {
+                    uint64_t delta;
+                    std::memcpy(&delta, record, sizeof(delta));
+                    previous += delta;
+                    std::memcpy(record, &previous, sizeof(previous));
+                }
+                offset += align(RECORD_ALIGNMENT + length, RECORD_ALIGNMENT);
+            }
+        }
+    }
+
+    FlightRecorder::FlightRecorder(size_t budget, size_t blockSize)
+        : blockSize(align(std::min(std::max(blockSize, size_t(256)), COMPRESS_MAX_BLOCK - ALIGNMENT)))
+    {
+        // The ring always holds at least one block, whatever the budget
+        size_t minimum = align(sizeof(Block) + this->blockSize) * 2;
+        size_t overhead = this->blockSize * 2 + COMPRESS_TABLE_SIZE * sizeof(uint16_t);
+        capacity = budget > overhead + minimum ? (budget - overhead) & ~(ALIGNMENT - 1) : minimum;
+
+        ring = std::make_unique<uint8_t[]>(capacity);
+        open = std::make_unique<uint8_t[]>(this->blockSize);
+        scratch = std::make_unique<uint8_t[]>(this->blockSize);
+        table = std::make_unique<uint16_t[]>(COMPRESS_TABLE_SIZE);
+    }
+
+    bool FlightRecorder::append(uint64_t timestamp, const uint8_t* record, size_t size)
+    {
+        size_t entry = align(RECORD_ALIGNMENT + size, RECORD_ALIGNMENT);
+        if (entry > blockSize)
+        {
+            ++dropped;
+            return false;
+        }
+
+        if (current.raw + entry > blockSize)
+            seal();
+
+        uint8_t* out = open.get() + current.raw;
+        uint32_t length = static_cast<uint32_t>(size);
+        std::memcpy(out, &length, sizeof(length));
+        std::memset(out + sizeof(length), 0, RECORD_ALIGNMENT - sizeof(length));
+        std::memcpy(out + RECORD_ALIGNMENT, record, size);
+        std::memset(out + RECORD_ALIGNMENT + size, 0, entry - RECORD_ALIGNMENT - size);
+
+        if (current.records == 0)
+            current.first = timestamp;
+        current.last = timestamp;
+        newest = timestamp;
+        current.raw += static_cast<uint32_t>(entry);
+        ++current.records;
+        return true;
+    }
+
+    void FlightRecorder::seal()
+    {
+        if (current.records == 0)
+            return;
+
+        // Keep the block as it is if compressing does not make it smaller
+        delta_encode(open.get(), current.raw);
+        const uint8_t* data = open.get();
+        size_t stored = compress_block(open.get(), current.raw, scratch.get(), current.raw - 1, table.get());
+        current.flags = 0;
+        if (stored != 0)
+        {
+            data = scratch.get();
+            current.flags = BLOCK_COMPRESSED;
+        }
+        else
+        {
+            stored = current.raw;
+        }
+        current.stored = static_cast<uint32_t>(stored);
+
+        // Blocks never wrap around the end of the ring
+        size_t size = align(sizeof(Block) + stored);
+        size_t offset = static_cast<size_t>(head % capacity);
+        size_t padding = capacity - offset < size ? capacity - offset : 0;
+        while (head + padding + size - tail > capacity)
+            popOldest();
+
+        if (padding != 0)
+        {
+            Block filler{0, 0, PADDING, 0, 0, 0};
+            std::memcpy(ring.get() + offset, &filler, sizeof(filler));
+            head += padding;
+            offset = 0;
+        }
+
+        std::memcpy(ring.get() + offset, &current, sizeof(current));
+        std::memcpy(ring.get() + offset + sizeof(current), data, stored);
+        head += size;
+
+        ++blocks;
+        records += current.records;
+        rawBytes += current.raw;
+        current = Block{};
+    }
+
+    const FlightRecorder::Block* FlightRecorder::oldest() const
+    {
+        if (tail == head)
+            return nullptr;
+
+        const Block* block = reinterpret_cast<const Block*>(ring.get() + tail % capacity);
+        if (block->stored == PADDING)
+            block = reinterpret_cast<const Block*>(ring.get());
+        return block;
+    }
+
+    void FlightRecorder::popOldest()
+    {
+        const Block* block = oldest();
+        if (!block)
+            return;
+
+        // Skip padding before the block, if any, along with the block itself
+        if (reinterpret_cast<const uint8_t*>(block) != ring.get() + tail % capacity)
+            tail += capacity - tail % capacity;
+        tail += align(sizeof(Block) + block->stored);
+
+        --blocks;
+        records -= block->records;
+        rawBytes -= block->raw;
+        evicted += block->records;
+    }
+
+    size_t FlightRecorder::replayBlock(const uint8_t* data, size_t size, const RecordFunction& consume)
+    {
+        size_t count = 0;
+        size_t offset = 0;
+        while (offset + RECORD_ALIGNMENT <= size)
+        {
+            uint32_t length;
+            std::memcpy(&length, data + offset, sizeof(length));
+            if (offset + RECORD_ALIGNMENT + length > size)
+                break;
+
+            consume(data + offset + RECORD_ALIGNMENT, length);
+            offset += align(RECORD_ALIGNMENT + length, RECORD_ALIGNMENT);
+            ++count;
+        }
+        return count;
+    }
+
+    size_t FlightRecorder::replay(const RecordFunction& consume) const
+    {
+        std::unique_ptr<uint8_t[]> block;
+        size_t count = 0;
+
+        uint64_t position = tail;
+        while (position != head)
+        {
+            const uint8_t* at = ring.get() + position % capacity;
+            Block header;
+            std::memcpy(&header, at, sizeof(header));
+            if (header.stored == PADDING)
+            {
+                position += capacity - position % capacity;
+                continue;
+            }
+
+            if (!block)
+                block = std::make_unique<uint8_t[]>(blockSize);
+
+            const uint8_t* data = at + sizeof(header);
+            size_t raw = header.stored;
+            if (header.flags & BLOCK_COMPRESSED)
+                raw = decompress_block(data, header.stored, block.get(), blockSize);
+            else
+                std::memcpy(block.get(), data, raw);
+
+            delta_decode(block.get(), raw);
+            count += replayBlock(block.get(), raw, consume);
+            position += align(sizeof(header) + header.stored);
+        }
+
+        return count + replayBlock(open.get(), current.raw, consume);
+    }
+
+    void FlightRecorder::clear()
+    {
+        head = tail = 0;
+        blocks = 0;
+        records = 0;
+        rawBytes = 0;
+        current = Block{};
+    }
+
+    FlightRecorderStats FlightRecorder::getStats() const
+    {
+        FlightRecorderStats stats;
+        stats.records = records + current.records;
+        stats.evicted = evicted;
+        stats.dropped = dropped;
+        stats.blocks = blocks;
+        stats.storedBytes = static_cast<size_t>(head - tail) + current.raw;
+        stats.rawBytes = rawBytes + current.raw;
+
+        const Block* block = oldest();
+        uint64_t first = block ? block->first : current.first;
+        stats.span = stats.records && newest > first ? newest - first : 0;
+        return stats;
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,57 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Hash provides the small, fast hash functions EmbedLog uses for throttle
+ * IDs, including a constexpr string hash for call site IDs and content
+ * hashes built from a format string and selected arguments without rendering
+ * the message.
+ *
+ */
+
+
+#include "EmbedLog/Hash.hpp"
+
+namespace EmbedLog
+{
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed)
+    {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        uint64_t hash = hash_mix(seed, size);
+
+        // Whole words first, loaded with memcpy so unaligned data is safe
+        while (size >= sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes, sizeof(word));
+            hash = hash_mix(hash, word);
+            bytes += sizeof(word);
+            size -= sizeof(word);
+        }
+
+        // Then the remaining bytes packed into one word
+        uint64_t tail = 0;
+        for (size_t i = 0; i < size; ++i)
+            tail |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+        return hash_mix(hash, tail);
+    }
+
+} // namespace EmbedLog
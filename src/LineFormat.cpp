@@ -0,0 +1,123 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * LineFormat turns the line format, such as "[%D:%H:%M:%S.%U %N %L] %T",
+ * into a renderer. Formats known at compile time become a straight-line
+ * renderer; others are compiled into a token list once when the log is
+ * created.
+ *
+ */
+
+
+#include "EmbedLog/LineFormat.hpp"
+
+namespace EmbedLog
+{
+    namespace
+    {
+        // Renders a line from the tokens of a format compiled at run-time
+        void render_tokens(std::string& out, const LineFields& fields, const LineFormat& format)
+        {
+            const std::string& text = format.getFormat();
+            const std::vector<LineToken>& tokens = format.getTokens();
+            LineClock local;
+            LineClock& time = fields.clock ? *fields.clock : local;
+            time.update(fields.microseconds);
+            size_t levelLength = detail::line_length(fields.level);
+
+            size_t reserve = 1 + fields.name.size() + levelLength + fields.message.size();
+            for (const LineToken& token : tokens)
+                reserve += token.field == LineField::TEXT ? token.length : detail::MAX_DAYS_DIGITS;
+
+            size_t start = out.size();
+            out.resize(start + reserve);
+
+            char* next = &out[start];
+            for (const LineToken& token : tokens)
+            {
+                switch (token.field)
+                {
+                case LineField::TEXT:
+                    for (uint16_t i = 0; i < token.length; ++i)
+                        *next++ = text[token.offset + i];
+                    break;
+                case LineField::NAME:
+                    next = detail::write_text(next, fields.name.data(), fields.name.size());
+                    break;
+                case LineField::LEVEL:
+                    next = detail::write_text(next, fields.level, levelLength);
+                    break;
+                case LineField::MESSAGE:
+                    next = detail::write_text(next, fields.message.data(), fields.message.size());
+                    break;
+                case LineField::DAYS:
+                    next = detail::write_days(next, time.days);
+                    break;
+                case LineField::HOURS:
+                    next = detail::write_pair(next, time.hours);
+                    break;
+                case LineField::MINUTES:
+                    next = detail::write_pair(next, time.minutes);
+                    break;
+                case LineField::SECONDS:
+                    next = detail::write_pair(next, time.seconds);
+                    break;
+                case LineField::MICROSECONDS:
+                    next = detail::write_micros(next, time.micros);
+                    break;
+                }
+            }
+            *next++ = '\n';
+            out.resize(next - out.data());
+        }
+    }
+
+    LineFormat::LineFormat(std::string format)
+        : format(std::move(format)), renderer(&render_tokens)
+    {
+        const std::string& text = this->format;
+        for (size_t i = 0; i < text.size(); ++i)
+        {
+            LineField field = text[i] == '%' && i + 1 < text.size() ? detail::line_field(text[i + 1]) : LineField::TEXT;
+            if (field != LineField::TEXT)
+            {
+                tokens.push_back({field, 0, 0});
+                ++i;
+            }
+            else if (!tokens.empty() && tokens.back().field == LineField::TEXT &&
+                     tokens.back().offset + tokens.back().length == i)
+            {
+                ++tokens.back().length;
+            }
+            else
+            {
+                tokens.push_back({LineField::TEXT, static_cast<uint16_t>(i), 1});
+            }
+        }
+    }
+
+    LineFormat::LineFormat(const char* format, LineRenderer renderer)
+        : format(format), renderer(renderer)
+    {
+    }
+
+} // namespace EmbedLog
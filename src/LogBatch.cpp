@@ -0,0 +1,82 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * LogBatch logs many messages with a single level check, clock read and
+ * enqueue, for dumping tables and state snapshots.
+ *
+ */
+
+
+#include "EmbedLog/EmbedLog.hpp"
+
+namespace EmbedLog
+{
+    LogBatch::LogBatch(EmbedLog* log, LogLevel level, size_t capacity)
+        : owner(log), record(nullptr), size(0), capacity(capacity), timestamp(0), level(level)
+    {
+        if (!owner)
+            return;
+
+        timestamp = owner->getTimestamp();
+        if (owner->records)
+        {
+            owner->publishThreadStage();
+            record = owner->records->reserve(sizeof(EmbedLog::DeferredRecord) + capacity);
+            if (!record)
+            {
+                EMBDL_PROBE1(drop, capacity);
+                owner = nullptr;
+            }
+        }
+    }
+
+    LogBatch::LogBatch(LogBatch&& other) noexcept
+        : owner(other.owner), record(other.record), size(other.size),
+          capacity(other.capacity), timestamp(other.timestamp), level(other.level)
+    {
+        other.owner = nullptr;
+        other.record = nullptr;
+    }
+
+    LogBatch::~LogBatch()
+    {
+        if (record)
+            owner->records->discard(record);
+    }
+
+    void LogBatch::commit()
+    {
+        if (record)
+        {
+            // One release store publishes every message in the batch
+            EmbedLog::DeferredRecord header{timestamp, nullptr, static_cast<uint32_t>(size),
+                                            static_cast<uint16_t>(level), EmbedLog::FORMAT_BATCH};
+            std::memcpy(record, &header, sizeof(header));
+            owner->records->commit(record, sizeof(header) + size);
+            EMBDL_PROBE2(enqueue, header.level, header.size);
+        }
+
+        owner = nullptr;
+        record = nullptr;
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,213 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * PersistentRegion writes lines into memory that survives a warm reset, such
+ * as a noinit section, so the last moments before a watchdog reset can be
+ * recovered on the next boot.
+ *
+ */
+
+
+#include "EmbedLog/PersistentRegion.hpp"
+#include "EmbedLog/Hash.hpp"
+
+#include <atomic>
+#include <cstring>
+
+#if defined(EMBEDLOG_NO_THREADS)
+#define EMBDL_REGION_LOCK(m)
+#else
+#define EMBDL_REGION_LOCK(m) std::lock_guard<std::mutex> embdl_lock(m)
+#endif
+
+namespace EmbedLog
+{
+    namespace
+    {
+        constexpr uint32_t REGION_MAGIC = 0x454D4231; // "EMB1"
+        constexpr size_t ALIGNMENT = 8;
+
+        size_t align(size_t size)
+        {
+            return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        }
+
+        // Keeps the compiler from moving writes to the region past each other, so a reset
+        // can only ever interrupt them in order
+        void order_writes()
+        {
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        }
+    }
+
+    PersistentRegion::PersistentRegion(void* region, size_t size)
+    {
+        uintptr_t start = reinterpret_cast<uintptr_t>(region);
+        size_t skip = align(start) - start;
+        size_t usable = size > skip + sizeof(Header) ? (size - skip - sizeof(Header)) & ~(ALIGNMENT - 1) : 0;
+
+        header = reinterpret_cast<Header*>(start + skip);
+        data = reinterpret_cast<uint8_t*>(header + 1);
+        capacity = usable;
+    }
+
+    uint32_t PersistentRegion::lineCheck(const char* text, size_t length, uint64_t position)
+    {
+        uint64_t hash = hash_bytes(text, length, hash_mix(HASH_SEED, position));
+        return static_cast<uint32_t>(hash ^ (hash >> 32));
+    }
+
+    bool PersistentRegion::isValid() const
+    {
+        if (capacity < sizeof(Entry))
+            return false;
+
+        uint64_t check = hash_mix(hash_mix(hash_mix(HASH_SEED, header->magic), header->boot), header->capacity);
+        return header->magic == REGION_MAGIC && header->capacity == capacity && header->check == check &&
+               header->tail <= header->head && header->head - header->tail <= capacity &&
+               header->head % ALIGNMENT == 0 && header->tail % ALIGNMENT == 0;
+    }
+
+    size_t PersistentRegion::recover(const LineFunction& consume) const
+    {
+        if (!isValid())
+            return 0;
+
+        std::string line;
+        size_t count = 0;
+        uint64_t position = header->tail;
+        uint64_t head = header->head;
+        while (position < head)
+        {
+            size_t offset = static_cast<size_t>(position % capacity);
+            if (capacity - offset < sizeof(Entry))
+                break;
+
+            Entry entry;
+            std::memcpy(&entry, data + offset, sizeof(entry));
+            if (entry.length == PADDING)
+            {
+                position += capacity - offset;
+                continue;
+            }
+
+            // Stop if the length is nonsense, as the lines after can no longer be found
+            const char* text = reinterpret_cast<const char*>(data + offset + sizeof(entry));
+            if (entry.length > capacity - offset - sizeof(entry) ||
+                position + align(sizeof(entry) + entry.length) > head)
+                break;
+
+            // Skip a line whose text was corrupted, but keep the newer lines after it
+            if (entry.check == lineCheck(text, entry.length, position))
+            {
+                line.assign(text, entry.length);
+                consume(line);
+                ++count;
+            }
+            position += align(sizeof(entry) + entry.length);
+        }
+        return count;
+    }
+
+    void PersistentRegion::reset()
+    {
+        if (capacity < sizeof(Entry))
+            return;
+
+        EMBDL_REGION_LOCK(mutex);
+        uint32_t boot = isValid() ? header->boot + 1 : 0;
+
+        // Invalidate the header first, so a reset part way through leaves nothing to recover
+        header->magic = 0;
+        order_writes();
+        header->boot = boot;
+        header->capacity = capacity;
+        header->head = 0;
+        header->tail = 0;
+        header->check = hash_mix(hash_mix(hash_mix(HASH_SEED, REGION_MAGIC), boot), capacity);
+        order_writes();
+        header->magic = REGION_MAGIC;
+        order_writes();
+    }
+
+    void PersistentRegion::write(const char* text, size_t length)
+    {
+        if (capacity < sizeof(Entry))
+            return;
+        if (length > capacity - sizeof(Entry))
+            length = capacity - sizeof(Entry);
+
+        // Until reset, head and tail are whatever the memory held at power on
+        EMBDL_REGION_LOCK(mutex);
+        if (!isValid())
+            return;
+        uint64_t head = header->head;
+        uint64_t tail = header->tail;
+
+        // Lines never wrap around the end of the region
+        size_t size = align(sizeof(Entry) + length);
+        size_t offset = static_cast<size_t>(head % capacity);
+        size_t padding = capacity - offset < size ? capacity - offset : 0;
+
+        // Give up the oldest lines before overwriting them
+        while (head + padding + size - tail > capacity)
+        {
+            if (tail == head)
+            {
+                tail = head + padding;
+                break;
+            }
+            size_t at = static_cast<size_t>(tail % capacity);
+            Entry entry;
+            std::memcpy(&entry, data + at, sizeof(entry));
+            tail += entry.length == PADDING ? capacity - at : align(sizeof(entry) + entry.length);
+        }
+        if (tail != header->tail)
+        {
+            header->tail = tail;
+            order_writes();
+        }
+
+        if (padding != 0)
+        {
+            Entry filler{PADDING, 0};
+            std::memcpy(data + offset, &filler, sizeof(filler));
+            head += padding;
+            offset = 0;
+        }
+
+        // The text, then its check, then the head that makes it visible
+        std::memcpy(data + offset + sizeof(Entry), text, length);
+        order_writes();
+        Entry entry{static_cast<uint32_t>(length), lineCheck(text, length, head)};
+        std::memcpy(data + offset, &entry, sizeof(entry));
+        order_writes();
+        header->head = head + size;
+        order_writes();
+    }
+
+    uint32_t PersistentRegion::getBoot() const
+    {
+        return isValid() ? header->boot : 0;
+    }
+
+} // namespace EmbedLog
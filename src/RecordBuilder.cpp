@@ -0,0 +1,214 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * RecordBuilder writes a message piece by piece straight into a record
+ * reserved in the deferred buffer, or into a line buffer reused by the
+ * thread, so messages can be built without intermediate copies.
+ *
+ */
+
+
+#include "EmbedLog/EmbedLog.hpp"
+
+#include <cstdio>
+#include <cstring>
+
+namespace EmbedLog
+{
+    namespace
+    {
+        // Line buffer reused by each thread, so building messages stops allocating once it has grown
+        thread_local std::string threadLine;
+        thread_local bool threadLineBusy = false;
+
+        // Scratch space for formatting values into deferred records
+        thread_local std::string threadScratch;
+    }
+
+    RecordBuilder::RecordBuilder(EmbedLog* log, LogLevel level, size_t capacity)
+        : log(log), record(nullptr), line(nullptr), size(0), capacity(capacity), timestamp(0), level(level)
+    {
+        if (!log)
+            return;
+
+        timestamp = log->getTimestamp();
+        if (log->records)
+        {
+            log->publishThreadStage();
+            record = log->records->reserve(sizeof(EmbedLog::DeferredRecord) + capacity);
+            if (!record)
+            {
+                EMBDL_PROBE1(drop, capacity);
+                this->log = nullptr;
+            }
+        }
+        else if (!threadLineBusy)
+        {
+            threadLineBusy = true;
+            threadLine.clear();
+            line = &threadLine;
+        }
+        else
+        {
+            line = new std::string(); // A message is already being built on this thread
+        }
+    }
+
+    RecordBuilder::RecordBuilder(RecordBuilder&& other) noexcept
+        : log(other.log), record(other.record), line(other.line), size(other.size),
+          capacity(other.capacity), timestamp(other.timestamp), level(other.level)
+    {
+        other.log = nullptr;
+        other.record = nullptr;
+        other.line = nullptr;
+    }
+
+    RecordBuilder::~RecordBuilder()
+    {
+        release();
+    }
+
+    void RecordBuilder::append(const char* data, size_t length)
+    {
+        if (!log)
+            return;
+
+        if (record && length > capacity - size)
+            length = capacity - size;
+
+        char* out = reserve(length);
+        std::memcpy(out, data, length);
+        advance(length);
+    }
+
+    char* RecordBuilder::reserve(size_t length)
+    {
+        if (!log)
+            return nullptr;
+
+        if (record)
+        {
+            if (length > capacity - size)
+                return nullptr;
+            return reinterpret_cast<char*>(record + sizeof(EmbedLog::DeferredRecord)) + size;
+        }
+
+        if (line->size() < size + length)
+            line->resize(size + length);
+        return &(*line)[size];
+    }
+
+    std::string& RecordBuilder::beginFormat()
+    {
+        if (line)
+        {
+            line->resize(size);
+            return *line;
+        }
+
+        threadScratch.clear();
+        return threadScratch;
+    }
+
+    void RecordBuilder::endFormat()
+    {
+        if (line)
+            size = line->size();
+        else
+            append(threadScratch.data(), threadScratch.size());
+    }
+
+    void RecordBuilder::advance(size_t length)
+    {
+        size += length;
+    }
+
+    void RecordBuilder::commit()
+    {
+        if (!log)
+            return;
+
+        if (record)
+        {
+            EmbedLog::DeferredRecord header{timestamp, nullptr, static_cast<uint32_t>(size),
+                                            static_cast<uint16_t>(level), EmbedLog::FORMAT_TEXT};
+            std::memcpy(record, &header, sizeof(header));
+            log->records->commit(record, sizeof(header) + size);
+            EMBDL_PROBE2(enqueue, header.level, header.size);
+            record = nullptr;
+        }
+        else
+        {
+            line->resize(size);
+            log->print(level, *line, timestamp);
+        }
+
+        release();
+    }
+
+    void RecordBuilder::release()
+    {
+        if (record)
+            log->records->discard(record);
+
+        if (line == &threadLine)
+            threadLineBusy = false;
+        else
+            delete line;
+
+        log = nullptr;
+        record = nullptr;
+        line = nullptr;
+    }
+
+    RecordBuilder& RecordBuilder::operator<<(const char* text)
+    {
+        append(text, std::strlen(text));
+        return *this;
+    }
+
+    RecordBuilder& RecordBuilder::operator<<(const std::string& text)
+    {
+        append(text.data(), text.size());
+        return *this;
+    }
+
+    RecordBuilder& RecordBuilder::operator<<(char c)
+    {
+        append(&c, 1);
+        return *this;
+    }
+
+    RecordBuilder& RecordBuilder::operator<<(bool value)
+    {
+        return *this << (value ? "true" : "false");
+    }
+
+    RecordBuilder& RecordBuilder::operator<<(double value)
+    {
+        char text[32];
+        int length = snprintf(text, sizeof(text), "%g", value);
+        append(text, length > 0 ? static_cast<size_t>(length) : 0);
+        return *this;
+    }
+
+} // namespace EmbedLog
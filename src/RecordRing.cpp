@@ -0,0 +1,140 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * RecordRing is a bounded, lock-free ring buffer of variable length records.
+ * Any number of producers, including interrupt handlers, reserve and commit
+ * records, while a single consumer drains them in order.
+ *
+ */
+
+
+#include "EmbedLog/RecordRing.hpp"
+
+#include <cstring>
+
+namespace EmbedLog
+{
+    namespace
+    {
+        constexpr size_t ALIGNMENT = 8;
+
+        size_t align(size_t size)
+        {
+            return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        }
+    }
+
+    RecordRing::RecordRing(size_t capacity)
+    {
+        size_t size = 64;
+        while (size < capacity)
+            size <<= 1;
+
+        // Zeroed memory reads as uncommitted headers
+        storage = std::make_unique<uint8_t[]>(size + ALIGNMENT);
+        buffer = reinterpret_cast<uint8_t*>(align(reinterpret_cast<uintptr_t>(storage.get())));
+        mask = size - 1;
+    }
+
+    uint8_t* RecordRing::reserve(size_t size)
+    {
+        uint64_t capacity = mask + 1;
+        uint64_t total = align(sizeof(Header) + size);
+        if (total > capacity)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        uint64_t head = writePosition.load(std::memory_order_relaxed);
+        uint64_t padding;
+        for (;;)
+        {
+            // Records that would run past the end of the buffer start again at the front
+            uint64_t offset = head & mask;
+            padding = capacity - offset < total ? capacity - offset : 0;
+
+            uint64_t tail = readPosition.load(std::memory_order_acquire);
+            if (head + padding + total - tail > capacity)
+            {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return nullptr;
+            }
+
+            if (writePosition.compare_exchange_weak(head, head + padding + total, std::memory_order_relaxed))
+                break;
+        }
+
+        if (padding != 0)
+        {
+            Header* filler = reinterpret_cast<Header*>(buffer + (head & mask));
+            filler->size = PADDING;
+            filler->total.store(static_cast<uint32_t>(padding), std::memory_order_release);
+            head += padding;
+        }
+
+        Header* header = reinterpret_cast<Header*>(buffer + (head & mask));
+        header->size = static_cast<uint32_t>(size);
+        return reinterpret_cast<uint8_t*>(header + 1);
+    }
+
+    void RecordRing::commit(uint8_t* record)
+    {
+        Header* header = reinterpret_cast<Header*>(record) - 1;
+        header->total.store(static_cast<uint32_t>(align(sizeof(Header) + header->size)), std::memory_order_release);
+    }
+
+    void RecordRing::commit(uint8_t* record, size_t size)
+    {
+        Header* header = reinterpret_cast<Header*>(record) - 1;
+        uint32_t total = static_cast<uint32_t>(align(sizeof(Header) + header->size));
+        header->size = static_cast<uint32_t>(size);
+        header->total.store(total, std::memory_order_release);
+    }
+
+    void RecordRing::discard(uint8_t* record)
+    {
+        commit(record, PADDING);
+    }
+
+    void RecordRing::release(Header* header, uint32_t total)
+    {
+        std::memset(reinterpret_cast<uint8_t*>(header) + sizeof(header->total), 0, total - sizeof(header->total));
+        header->total.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t RecordRing::getDropped() const
+    {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+    void RecordRing::addDropped(uint64_t count)
+    {
+        dropped.fetch_add(count, std::memory_order_relaxed);
+    }
+
+    size_t RecordRing::getCapacity() const
+    {
+        return static_cast<size_t>(mask + 1);
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,136 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * RenderPool is a small pool of threads that flush uses to format deferred
+ * messages in parallel. Without threads (EMBEDLOG_NO_THREADS) it runs every
+ * task on the calling thread.
+ *
+ */
+
+
+#include "EmbedLog/RenderPool.hpp"
+
+namespace EmbedLog
+{
+#if defined(EMBEDLOG_NO_THREADS)
+
+    RenderPool::RenderPool(size_t)
+    {
+    }
+
+    RenderPool::~RenderPool()
+    {
+    }
+
+    void RenderPool::run(size_t count, const std::function<void(size_t)>& task)
+    {
+        for (size_t i = 0; i < count; ++i)
+            task(i);
+    }
+
+    size_t RenderPool::getThreads() const
+    {
+        return 1;
+    }
+
+#else
+
+    RenderPool::RenderPool(size_t threads)
+    {
+        for (size_t i = 1; i < threads; ++i)
+        {
+            workers.emplace_back([this]() {
+                unsigned long long seen = 0;
+                std::unique_lock<std::mutex> lock(mutex);
+                for (;;)
+                {
+                    started.wait(lock, [&]() { return stopping || generation != seen; });
+                    if (stopping)
+                        return;
+
+                    seen = generation;
+                    lock.unlock();
+                    work();
+                    lock.lock();
+
+                    if (--busy == 0)
+                        finished.notify_one();
+                }
+            });
+        }
+    }
+
+    RenderPool::~RenderPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        started.notify_all();
+
+        for (std::thread& worker : workers)
+            worker.join();
+    }
+
+    void RenderPool::run(size_t count, const std::function<void(size_t)>& task)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current = &task;
+            this->count = count;
+            next = 0;
+            busy = workers.size();
+            ++generation;
+        }
+        started.notify_all();
+
+        // The caller takes tasks too, then waits for the workers to finish theirs
+        work();
+
+        std::unique_lock<std::mutex> lock(mutex);
+        finished.wait(lock, [this]() { return busy == 0; });
+        current = nullptr;
+    }
+
+    size_t RenderPool::getThreads() const
+    {
+        return workers.size() + 1;
+    }
+
+    void RenderPool::work()
+    {
+        for (;;)
+        {
+            size_t task;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (next >= count)
+                    return;
+                task = next++;
+            }
+            (*current)(task);
+        }
+    }
+
+#endif
+
+} // namespace EmbedLog
@@ -0,0 +1,216 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * SinkQueue holds rendered lines for one extra sink, so a slow sink falls
+ * behind or drops lines on its own rather than holding up the log and its
+ * other sinks.
+ *
+ */
+
+
+#include "EmbedLog/SinkQueue.hpp"
+
+#include <cstring>
+
+#if defined(EMBEDLOG_NO_THREADS)
+#define EMBDL_SINK_LOCK(m)
+#else
+#define EMBDL_SINK_LOCK(m) std::lock_guard<std::mutex> embdl_lock(m)
+#endif
+
+namespace EmbedLog
+{
+    namespace
+    {
+        constexpr size_t ALIGNMENT = 16;
+
+        size_t align(size_t size)
+        {
+            return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+        }
+    }
+
+    SinkQueue::SinkQueue(SinkFunction sink, size_t capacity, SinkPolicy policy, bool ownThread)
+        : sink(std::move(sink)), capacity(align(capacity > 64 ? capacity : 64)), policy(policy)
+    {
+        buffer = std::make_unique<uint8_t[]>(this->capacity);
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        if (ownThread)
+        {
+            worker = std::thread([this]() {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stopping)
+                {
+                    ready.wait(lock, [this]() { return stopping || lines > 0; });
+                    lock.unlock();
+                    deliver();
+                    lock.lock();
+                }
+            });
+        }
+#else
+        (void)ownThread;
+#endif
+    }
+
+    SinkQueue::~SinkQueue()
+    {
+#if !defined(EMBEDLOG_NO_THREADS)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        ready.notify_one();
+        if (worker.joinable())
+            worker.join();
+#endif
+        deliver();
+    }
+
+    void SinkQueue::push(uint64_t timestamp, const char* text, size_t length)
+    {
+        size_t size = align(sizeof(Entry) + length);
+        {
+            EMBDL_SINK_LOCK(mutex);
+            if (size > capacity)
+            {
+                ++dropped;
+                return;
+            }
+
+            // Lines never wrap around the end of the buffer, and an empty queue starts again
+            // at the front, so any line that fits the buffer fits an empty queue
+            if (tail == head)
+                restart();
+            size_t offset = static_cast<size_t>(head % capacity);
+            size_t padding = capacity - offset < size ? capacity - offset : 0;
+            while (head + padding + size - tail > capacity)
+            {
+                if (policy == SinkPolicy::DROP_NEWEST || lines == 0)
+                {
+                    ++dropped;
+                    return;
+                }
+                popOldest();
+                ++dropped;
+                if (tail == head)
+                {
+                    restart();
+                    offset = 0;
+                    padding = 0;
+                }
+            }
+
+            if (padding != 0)
+            {
+                Entry filler{0, PADDING, 0};
+                std::memcpy(buffer.get() + offset, &filler, sizeof(filler));
+                head += padding;
+                offset = 0;
+            }
+
+            Entry entry{timestamp, static_cast<uint32_t>(length), 0};
+            std::memcpy(buffer.get() + offset, &entry, sizeof(entry));
+            std::memcpy(buffer.get() + offset + sizeof(entry), text, length);
+            head += size;
+            newest = timestamp;
+            ++lines;
+        }
+
+#if !defined(EMBEDLOG_NO_THREADS)
+        if (worker.joinable())
+            ready.notify_one();
+#endif
+    }
+
+    size_t SinkQueue::deliver(size_t limit)
+    {
+#if !defined(EMBEDLOG_NO_THREADS)
+        std::lock_guard<std::mutex> order(delivering);
+#endif
+        size_t count = 0;
+        while (count < limit)
+        {
+            {
+                EMBDL_SINK_LOCK(mutex);
+                const Entry* entry = oldest();
+                if (!entry)
+                    break;
+
+                // Copy the line out so the sink writes without holding the lock
+                line.assign(reinterpret_cast<const char*>(entry + 1), entry->length);
+                popOldest();
+                ++delivered;
+            }
+
+            sink(line);
+            ++count;
+        }
+        return count;
+    }
+
+    SinkStats SinkQueue::getStats() const
+    {
+        EMBDL_SINK_LOCK(mutex);
+        SinkStats stats;
+        stats.delivered = delivered;
+        stats.dropped = dropped;
+        stats.queuedLines = lines;
+        stats.queuedBytes = static_cast<size_t>(head - tail);
+
+        const Entry* entry = oldest();
+        stats.lag = entry && newest > entry->timestamp ? newest - entry->timestamp : 0;
+        return stats;
+    }
+
+    const SinkQueue::Entry* SinkQueue::oldest() const
+    {
+        if (tail == head)
+            return nullptr;
+
+        const Entry* entry = reinterpret_cast<const Entry*>(buffer.get() + tail % capacity);
+        if (entry->length == PADDING)
+            entry = reinterpret_cast<const Entry*>(buffer.get());
+        return entry;
+    }
+
+    void SinkQueue::restart()
+    {
+        head += (capacity - head % capacity) % capacity;
+        tail = head;
+    }
+
+    void SinkQueue::popOldest()
+    {
+        const Entry* entry = oldest();
+        if (!entry)
+            return;
+
+        // Skip padding before the entry, if any, along with the entry itself
+        if (reinterpret_cast<const uint8_t*>(entry) != buffer.get() + tail % capacity)
+            tail += capacity - tail % capacity;
+        tail += align(sizeof(Entry) + entry->length);
+        --lines;
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,198 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * ThrottleTable is a fixed-capacity, open-addressed table of throttle IDs
+ * and their last message times. Entries are reclaimed once their throttle
+ * window has passed, and the least recently logged entry is evicted when a
+ * neighbourhood is full, so memory stays bounded however many IDs are seen.
+ *
+ */
+
+
+#include "EmbedLog/ThrottleTable.hpp"
+
+namespace EmbedLog
+{
+    namespace
+    {
+        // A per-thread record of when a suppressed ID is next due
+        struct CachedThrottle
+        {
+            uint64_t tag = 0;      // Hash of the table generation and key, or 0 if unused.
+            uint64_t due = 0;      // Time after which the ID may be logged again.
+        };
+
+        constexpr size_t THREAD_CACHE_SIZE = 16;
+        thread_local CachedThrottle threadCacheEntries[THREAD_CACHE_SIZE];
+
+        std::atomic<uint64_t> nextGeneration{1};
+
+        // Key of a slot whose entry is being written, published once its last and window are set
+        constexpr uint64_t CLAIMING = ~0ull;
+
+        // Keys of zero mark empty slots and CLAIMING marks slots being written, so those IDs are stored under different keys
+        uint64_t to_key(size_t id)
+        {
+            uint64_t key = static_cast<uint64_t>(id);
+            return key != 0 && key != CLAIMING ? key : key ^ 0x9E3779B97F4A7C15ull;
+        }
+
+        // Spreads IDs that are poorly distributed, such as aligned addresses
+        uint64_t to_index(uint64_t key)
+        {
+            key ^= key >> 33;
+            key *= 0xFF51AFD7ED558CCDull;
+            key ^= key >> 33;
+            return key;
+        }
+
+        // A time before the last message, from a thread with an older clock reading, counts as inside the window
+        bool is_expired(uint64_t now_us, uint64_t last, uint64_t window)
+        {
+            return now_us > last && now_us - last > window;
+        }
+    }
+
+    ThrottleTable::ThrottleTable(size_t capacity, bool threadCache)
+        : generation(nextGeneration.fetch_add(1, std::memory_order_relaxed)),
+          threadCache(threadCache)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size <<= 1;
+
+        slots = std::make_unique<Slot[]>(size);
+        mask = size - 1;
+    }
+
+    bool ThrottleTable::acquire(size_t id, uint64_t window_us, uint64_t now_us)
+    {
+        uint64_t key = to_key(id);
+        uint64_t index = to_index(key);
+
+        CachedThrottle* cached = nullptr;
+        uint64_t tag = 0;
+        if (threadCache)
+        {
+            tag = (index ^ generation * 0x9E3779B97F4A7C15ull) | 1;
+            cached = &threadCacheEntries[(index >> 32) & (THREAD_CACHE_SIZE - 1)];
+            if (cached->tag == tag && now_us <= cached->due)
+                return false;
+        }
+
+        size_t probes = mask + 1 < PROBE_LENGTH ? mask + 1 : PROBE_LENGTH;
+
+        Slot* victim = nullptr;
+        uint64_t victimKey = 0;
+        bool victimExpired = false;
+        for (size_t i = 0; i < probes; ++i)
+        {
+            Slot& slot = slots[(index + i) & mask];
+            uint64_t slotKey = slot.key.load(std::memory_order_acquire);
+            if (slotKey == key)
+            {
+                uint64_t last = slot.last.load(std::memory_order_relaxed);
+                for (;;)
+                {
+                    uint64_t window = slot.window.load(std::memory_order_relaxed);
+                    if (!is_expired(now_us, last, window))
+                    {
+                        if (cached)
+                            *cached = CachedThrottle{tag, last + window};
+                        return false;
+                    }
+
+                    if (slot.last.compare_exchange_weak(last, now_us, std::memory_order_relaxed))
+                    {
+                        slot.window.store(window_us, std::memory_order_relaxed);
+                        return true;
+                    }
+                }
+            }
+
+            // Prefer an empty slot, then an expired one, then the least recently logged
+            if (slotKey == CLAIMING || (victim != nullptr && (victimKey == 0 || victimExpired)))
+                continue;
+
+            uint64_t last = slot.last.load(std::memory_order_relaxed);
+            bool expired = slotKey != 0 && is_expired(now_us, last, slot.window.load(std::memory_order_relaxed));
+            if (victim == nullptr || slotKey == 0 || expired || last < victim->last.load(std::memory_order_relaxed))
+            {
+                victim = &slot;
+                victimKey = slotKey;
+                victimExpired = expired;
+            }
+        }
+
+        // An unseen ID behaves as if it was last logged at time zero
+        if (now_us <= window_us)
+            return false;
+
+        // If every slot nearby is being claimed, or another thread claims this one first,
+        // the message is let through untracked
+        if (!victim || !victim->key.compare_exchange_strong(victimKey, CLAIMING, std::memory_order_acq_rel))
+            return true;
+
+        // Publish the key last, so no thread reads it with the previous entry's times
+        victim->last.store(now_us, std::memory_order_relaxed);
+        victim->window.store(window_us, std::memory_order_relaxed);
+        victim->key.store(key, std::memory_order_release);
+
+        if (victimKey == 0)
+            occupied.fetch_add(1, std::memory_order_relaxed);
+        else if (victimExpired)
+            expirations.fetch_add(1, std::memory_order_relaxed);
+        else
+            evictions.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    void ThrottleTable::expire(uint64_t now_us)
+    {
+        for (size_t i = 0; i <= mask; ++i)
+        {
+            Slot& slot = slots[i];
+            uint64_t key = slot.key.load(std::memory_order_acquire);
+            if (key == 0 || key == CLAIMING)
+                continue;
+
+            uint64_t last = slot.last.load(std::memory_order_relaxed);
+            if (is_expired(now_us, last, slot.window.load(std::memory_order_relaxed)) &&
+                slot.key.compare_exchange_strong(key, 0, std::memory_order_acq_rel))
+            {
+                occupied.fetch_sub(1, std::memory_order_relaxed);
+                expirations.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ThrottleStats ThrottleTable::getStats() const
+    {
+        ThrottleStats stats;
+        stats.capacity = mask + 1;
+        stats.occupied = occupied.load(std::memory_order_relaxed);
+        stats.expirations = expirations.load(std::memory_order_relaxed);
+        stats.evictions = evictions.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+} // namespace EmbedLog
@@ -0,0 +1,102 @@
+/*
+ * EmbedLog - A Minimal Logging Library for Embedded Systems
+ *
+ * Copyright (C) 2023 Joe Inman
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the MIT License as published by
+ * the Open Source Initiative.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * MIT License for more details.
+ *
+ * You should have received a copy of the MIT License along with this program.
+ * If not, see <https://opensource.org/licenses/MIT>.
+ *
+ * Author: Joe Inman
+ * Email: joe.inman8@gmail.com
+ * Version: 1.0
+ *
+ * Description:
+ * Trace writes span and instant events in the Chrome Trace Event format, so
+ * a log can also be opened as a timeline in chrome://tracing or Perfetto.
+ *
+ */
+
+
+#include "EmbedLog/Trace.hpp"
+
+#include <atomic>
+#include <charconv>
+
+namespace EmbedLog
+{
+    namespace
+    {
+        std::atomic<uint32_t> nextThreadId{1};
+
+        void append_number(std::string& out, uint64_t value)
+        {
+            char text[24];
+            out.append(text, std::to_chars(text, text + sizeof(text), value).ptr);
+        }
+
+        void append_json_string(std::string& out, const char* text)
+        {
+            static const char HEX[] = "0123456789abcdef";
+
+            out += '"';
+            for (; *text; ++text)
+            {
+                unsigned char c = static_cast<unsigned char>(*text);
+                if (c == '"' || c == '\\')
+                {
+                    out += '\\';
+                    out += static_cast<char>(c);
+                }
+                else if (c < 0x20)
+                {
+                    out += "\\u00";
+                    out += HEX[c >> 4];
+                    out += HEX[c & 0xF];
+                }
+                else
+                {
+                    out += static_cast<char>(c);
+                }
+            }
+            out += '"';
+        }
+    }
+
+    uint32_t trace_thread_id()
+    {
+        thread_local uint32_t id = nextThreadId.fetch_add(1, std::memory_order_relaxed);
+        return id;
+    }
+
+    void append_trace_event(std::string& out, char phase, const char* name, uint64_t timestamp, uint32_t thread, uint64_t duration)
+    {
+        out += "{\"name\":";
+        append_json_string(out, name);
+        out += ",\"ph\":\"";
+        out += phase;
+        out += "\",\"ts\":";
+        append_number(out, timestamp);
+        if (phase == TRACE_COMPLETE)
+        {
+            out += ",\"dur\":";
+            append_number(out, duration);
+        }
+        else if (phase == TRACE_INSTANT)
+        {
+            out += ",\"s\":\"t\"";
+        }
+        out += ",\"pid\":1,\"tid\":";
+        append_number(out, thread);
+        out += '}';
+    }
+
+} // namespace EmbedLog